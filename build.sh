@@ -2,19 +2,21 @@
 
 EXE='SimpleScript'
 EXE_TEST='SimpleScriptTest'
+EXE_BENCH='SimpleScriptBench'
 
 setup=0
 clean=0
 build=0
 slow_build=0
 run_tests=0
+run_bench=0
 gen_coverage=0
 run=0
 
 proj_root="$(dirname "$0")"
 build_dir="${proj_root}/build"
 
-while getopts 'hicbstgra' flag; do
+while getopts 'hicbstpgra' flag; do
 	case "$flag" in
 		h)
 			echo 'build.sh [flags]'
@@ -35,6 +37,9 @@ while getopts 'hicbstgra' flag; do
 		t)
 			run_tests=1
 			;;
+		p)
+			run_bench=1
+			;;
 		g)
 			gen_coverage=1
 			;;
@@ -86,6 +91,10 @@ if [ $run_tests -eq 1 ]; then
 	fi
 fi
 
+if [ $run_bench -eq 1 ]; then
+	"${build_dir}/${EXE_BENCH}" || exit $?
+fi
+
 if [ $gen_coverage -eq 1 ]; then
 	cur_dir=$(pwd)
 	cd "${build_dir}"
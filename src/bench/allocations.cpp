@@ -0,0 +1,39 @@
+#include "allocations.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+  std::atomic_size_t allocations = 0;
+}  // namespace
+
+// every allocation in the benchmark process is counted so workloads can report how much they hit the heap
+
+auto operator new(std::size_t size) -> void*
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+namespace bench
+{
+  auto allocation_count() noexcept -> std::size_t
+  {
+    return allocations.load(std::memory_order_relaxed);
+  }
+}  // namespace bench
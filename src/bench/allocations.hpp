@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+
+namespace bench
+{
+  /**
+   * @brief Number of times operator new has been called in the process so far
+   */
+  auto allocation_count() noexcept -> std::size_t;
+}  // namespace bench
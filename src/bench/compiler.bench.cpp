@@ -0,0 +1,166 @@
+#include "allocations.hpp"
+#include "generator.hpp"
+#include "helpers.hpp"
+
+#include "ss/code.hpp"
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <string>
+
+using bench::SourceShape;
+using ss::Compiler;
+using ss::Parser;
+using ss::Program;
+using ss::Scanner;
+
+namespace
+{
+  const std::string WORKLOADS = std::string{
+#include "scripts/fib_script.ss"
+                                }
+                                + std::string{
+#include "scripts/loop_script.ss"
+                                }
+                                + std::string{
+#include "scripts/string_concat_script.ss"
+                                }
+                                + std::string{
+#include "scripts/match_table_script.ss"
+                                }
+                                + std::string{
+#include "scripts/match_linear_script.ss"
+                                };
+
+  /**
+   * @brief How much the resident set grows while a stage runs, sampled around each iteration with the timer paused. The
+   * largest growth is kept, the first iteration's usually, as later ones reuse the memory it freed
+   */
+  class RssGrowth
+  {
+   public:
+    void before() noexcept
+    {
+      bench::release_free_memory();
+      this->start = bench::resident_kb();
+    }
+
+    void after() noexcept
+    {
+      this->largest = std::max(this->largest, bench::resident_kb() - this->start);
+    }
+
+    void report(benchmark::State& state) const
+    {
+      state.counters["rss_growth_kb"] = benchmark::Counter(static_cast<double>(this->largest));
+    }
+
+   private:
+    long start   = 0;
+    long largest = 0;
+  };
+
+  /**
+   * @brief Scans the generated script, counting source bytes
+   */
+  void scan(benchmark::State& state, SourceShape shape)
+  {
+    auto src = bench::generate_source(shape, static_cast<std::size_t>(state.range(0)));
+
+    std::size_t tokens = 0;
+    RssGrowth rss;
+    for (auto _ : state) {
+      state.PauseTiming();
+      auto copy = src;
+      rss.before();
+      state.ResumeTiming();
+
+      Scanner scanner(std::move(copy));
+      auto token_list = scanner.scan();
+      tokens          = token_list.size();
+      benchmark::DoNotOptimize(tokens);
+
+      state.PauseTiming();
+      rss.after();
+      state.ResumeTiming();
+    }
+
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * src.size()));
+    state.counters["tokens"] = benchmark::Counter(static_cast<double>(tokens));
+    rss.report(state);
+  }
+
+  /**
+   * @brief Parses the already scanned script, counting tokens & emitted instructions
+   */
+  void parse(benchmark::State& state, SourceShape shape)
+  {
+    auto src = bench::generate_source(shape, static_cast<std::size_t>(state.range(0)));
+
+    std::size_t tokens       = 0;
+    std::size_t instructions = 0;
+    std::size_t allocations  = 0;
+    RssGrowth rss;
+    for (auto _ : state) {
+      state.PauseTiming();
+      auto copy = src;
+      Scanner scanner(std::move(copy));
+      auto token_list = scanner.scan();
+      tokens          = token_list.size();
+      Program program;
+      rss.before();
+      state.ResumeTiming();
+
+      auto allocations_before = bench::allocation_count();
+      Parser parser(std::move(token_list), program, "bench");
+      parser.parse();
+      allocations  = bench::allocation_count() - allocations_before;
+      instructions = program.instruction_count();
+      benchmark::DoNotOptimize(instructions);
+
+      state.PauseTiming();
+      rss.after();
+      state.ResumeTiming();
+    }
+
+    auto iterations                = static_cast<double>(state.iterations());
+    state.counters["tokens/s"]     = benchmark::Counter(iterations * tokens, benchmark::Counter::kIsRate);
+    state.counters["instrs/s"]     = benchmark::Counter(iterations * instructions, benchmark::Counter::kIsRate);
+    state.counters["instructions"] = benchmark::Counter(static_cast<double>(instructions));
+    state.counters["allocations"]  = benchmark::Counter(static_cast<double>(allocations));
+    rss.report(state);
+  }
+}  // namespace
+
+static void compile_only(benchmark::State& state)
+{
+  Compiler compiler;
+
+  std::size_t allocations = 0;
+  for (auto _ : state) {
+    Program program;
+    auto allocations_before = bench::allocation_count();
+    compiler.compile(std::string(WORKLOADS), program, "bench");
+    allocations = bench::allocation_count() - allocations_before;
+    benchmark::DoNotOptimize(program.instruction_count());
+  }
+
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * WORKLOADS.size()));
+  state.counters["allocations"] = benchmark::Counter(static_cast<double>(allocations));
+}
+BENCHMARK(compile_only)->Unit(benchmark::kMicrosecond);
+
+#define SS_COMPILER_BENCHMARK(stage, shape)                                                                                    \
+  BENCHMARK_CAPTURE(stage, shape, SourceShape::shape)                                                                          \
+   ->RangeMultiplier(8)                                                                                                        \
+   ->Range(1 << 10, 1 << 20)                                                                                                   \
+   ->Unit(benchmark::kMillisecond)
+
+SS_COMPILER_BENCHMARK(scan, FUNCTIONS);
+SS_COMPILER_BENCHMARK(scan, NESTING);
+SS_COMPILER_BENCHMARK(scan, STRINGS);
+SS_COMPILER_BENCHMARK(scan, GLOBALS);
+SS_COMPILER_BENCHMARK(parse, FUNCTIONS);
+SS_COMPILER_BENCHMARK(parse, NESTING);
+SS_COMPILER_BENCHMARK(parse, STRINGS);
+SS_COMPILER_BENCHMARK(parse, GLOBALS);
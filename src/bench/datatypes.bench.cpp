@@ -0,0 +1,65 @@
+#include "helpers.hpp"
+
+#include "ss/code.hpp"
+#include "ss/datatypes.hpp"
+
+#include <array>
+#include <benchmark/benchmark.h>
+#include <string>
+
+using ss::Compiler;
+using ss::Program;
+using ss::Value;
+
+namespace
+{
+  /**
+   * @brief Integers, common decimals, and values that print in scientific notation
+   */
+  const std::array<Value::NumberType, 8> NUMBERS = {0, 7, 42, 1234, 0.5, 3.14159, 1e-7, 123456789};
+}  // namespace
+
+static void number_to_string(benchmark::State& state)
+{
+  for (auto _ : state) {
+    for (auto number : NUMBERS) {
+      auto str = Value(number).to_string();
+      benchmark::DoNotOptimize(str);
+    }
+  }
+
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * NUMBERS.size()));
+}
+BENCHMARK(number_to_string);
+
+static void number_concatenation(benchmark::State& state)
+{
+  Value label("took ");
+  for (auto _ : state) {
+    for (auto number : NUMBERS) {
+      auto str = label + Value(number);
+      benchmark::DoNotOptimize(str);
+    }
+  }
+
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * NUMBERS.size()));
+}
+BENCHMARK(number_concatenation);
+
+static void number_literals(benchmark::State& state)
+{
+  std::string src;
+  for (std::int64_t i = 0; i < state.range(0); i++) {
+    src += std::to_string(i) + ".375;\n";
+  }
+
+  Compiler compiler;
+  for (auto _ : state) {
+    Program program;
+    compiler.compile(std::string(src), program, "bench");
+    benchmark::DoNotOptimize(program.instruction_count());
+  }
+
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * state.range(0)));
+}
+BENCHMARK(number_literals)->Arg(1 << 12)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,103 @@
+#include "generator.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+#if defined(__GLIBC__)
+#  include <malloc.h>
+#endif
+
+namespace bench
+{
+  namespace
+  {
+    constexpr std::size_t NESTING_DEPTH = 32;
+    constexpr std::size_t STRING_LENGTH = 200;
+
+    void functions(std::ostream& out, std::size_t lines)
+    {
+      out << "fn f_0(a, b) { ret a + b; }\n";
+      for (std::size_t i = 1; i * 6 < lines; i++) {
+        out << "fn f_" << i << "(a, b) {\n";
+        out << "  let c = a * b + " << i << ";\n";
+        out << "  if c > " << i << " {\n";
+        out << "    ret f_" << i - 1 << "(c, b);\n";
+        out << "  }\n";
+        out << "  ret c;\n";
+        out << "}\n";
+      }
+    }
+
+    void nesting(std::ostream& out, std::size_t lines)
+    {
+      out << "let v = 1;\n";
+      for (std::size_t written = 0; written < lines; written += NESTING_DEPTH * 2 + 1) {
+        for (std::size_t depth = 0; depth < NESTING_DEPTH; depth++) {
+          out << std::string(depth * 2, ' ') << "if v > " << depth << " {\n";
+        }
+        out << std::string(NESTING_DEPTH * 2, ' ') << "v = v + 1;\n";
+        for (std::size_t depth = NESTING_DEPTH; depth > 0; depth--) { out << std::string((depth - 1) * 2, ' ') << "}\n"; }
+      }
+    }
+
+    void strings(std::ostream& out, std::size_t lines)
+    {
+      for (std::size_t i = 0; i < lines; i++) {
+        out << "let s_" << i << " = \"" << std::string(STRING_LENGTH, static_cast<char>('a' + i % 26)) << "\" + \""
+            << std::string(STRING_LENGTH / 2, 'z') << "\";\n";
+      }
+    }
+
+    void globals(std::ostream& out, std::size_t lines)
+    {
+      out << "let g_0 = 0;\n";
+      for (std::size_t i = 1; i < lines; i++) {
+        if (i % 2 == 0) {
+          out << "let g_" << i << " = g_" << i - 1 << " + " << i << ";\n";
+        } else {
+          out << "let g_" << i << " = " << i << ";\n";
+        }
+      }
+    }
+  }  // namespace
+
+  auto generate_source(SourceShape shape, std::size_t lines) -> std::string
+  {
+    std::stringstream out;
+    switch (shape) {
+      case SourceShape::FUNCTIONS: {
+        functions(out, lines);
+      } break;
+      case SourceShape::NESTING: {
+        nesting(out, lines);
+      } break;
+      case SourceShape::STRINGS: {
+        strings(out, lines);
+      } break;
+      case SourceShape::GLOBALS: {
+        globals(out, lines);
+      } break;
+    }
+    return out.str();
+  }
+
+  auto resident_kb() noexcept -> long
+  {
+    // the second field is the resident pages
+    std::ifstream statm("/proc/self/statm");
+    long size     = 0;
+    long resident = 0;
+    if (!(statm >> size >> resident)) {
+      return 0;
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+  }
+
+  void release_free_memory() noexcept
+  {
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+  }
+}  // namespace bench
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace bench
+{
+  /**
+   * @brief The construct a generated script is made of, each stressing a different part of the compiler
+   */
+  enum class SourceShape
+  {
+    FUNCTIONS,
+    NESTING,
+    STRINGS,
+    GLOBALS,
+  };
+
+  /**
+   * @brief Generates a valid script of roughly the given number of lines made of the shape
+   */
+  auto generate_source(SourceShape shape, std::size_t lines) -> std::string;
+
+  /**
+   * @brief Resident set size of the process right now, in kilobytes, or 0 where it cannot be read
+   */
+  auto resident_kb() noexcept -> long;
+
+  /**
+   * @brief Hands the memory the allocator kept from earlier work back to the system, so growth measured after it belongs to
+   * what runs next rather than being hidden by reuse
+   */
+  void release_free_memory() noexcept;
+}  // namespace bench
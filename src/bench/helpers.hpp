@@ -0,0 +1,16 @@
+#pragma once
+
+#include "ss/vm.hpp"
+
+#include <memory>
+#include <ostream>
+
+#define BENCH_SCRIPT(src) #src
+
+namespace bench
+{
+  /**
+   * @brief Creates a vm whose output is discarded, with the natives the workloads call already defined
+   */
+  auto make_vm(std::ostream& null) -> std::unique_ptr<ss::VM>;
+}  // namespace bench
@@ -0,0 +1,281 @@
+#include "helpers.hpp"
+#include "ss/pool.hpp"
+#include "ss/util.hpp"
+
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+using ss::Dispatch;
+using ss::FlushPolicy;
+using ss::NativeFunction;
+using ss::OutputConfig;
+using ss::Value;
+using ss::VM;
+using ss::VMConfig;
+using ss::VMPool;
+
+namespace bench
+{
+  auto make_vm(std::ostream& null) -> std::unique_ptr<VM>
+  {
+    auto vm = std::make_unique<VM>(VMConfig(&std::cin, &null));
+    vm->set_var("identity", Value(vm->make<NativeFunction>("identity", 1, [](NativeFunction::Args&& args) {
+                  return args[0];
+                })));
+    return vm;
+  }
+}  // namespace bench
+
+namespace
+{
+  void run_workload(benchmark::State& state, const char* script)
+  {
+    std::ostream null(nullptr);
+
+    for (auto _ : state) {
+      // globals outlive a script, so each run gets a fresh vm to define them in
+      state.PauseTiming();
+      auto vm = bench::make_vm(null);
+      state.ResumeTiming();
+
+      auto result = vm->run_script(script);
+      benchmark::DoNotOptimize(result);
+    }
+  }
+}  // namespace
+
+static void recursion(benchmark::State& state)
+{
+  run_workload(state, {
+#include "scripts/fib_script.ss"
+  });
+}
+BENCHMARK(recursion)->Unit(benchmark::kMillisecond);
+
+static void loops(benchmark::State& state)
+{
+  run_workload(state, {
+#include "scripts/loop_script.ss"
+  });
+}
+BENCHMARK(loops)->Unit(benchmark::kMillisecond);
+
+static void string_concatenation(benchmark::State& state)
+{
+  run_workload(state, {
+#include "scripts/string_concat_script.ss"
+  });
+}
+BENCHMARK(string_concatenation)->Unit(benchmark::kMillisecond);
+
+static void report_generation(benchmark::State& state)
+{
+  run_workload(state, {
+#include "scripts/report_script.ss"
+  });
+}
+BENCHMARK(report_generation)->Unit(benchmark::kMillisecond);
+
+static void printing(benchmark::State& state)
+{
+  // a real stream like std::cout, rather than one without a buffer
+  std::ofstream null("/dev/null");
+  int fd = state.range(1) ? open("/dev/null", O_WRONLY) : OutputConfig::NO_FD;
+
+  OutputConfig output{.flush = static_cast<FlushPolicy>(state.range(0)), .fd = fd};
+  for (auto _ : state) {
+    state.PauseTiming();
+    VM vm(VMConfig(&std::cin, &null, output));
+    state.ResumeTiming();
+
+    vm.run_script({
+#include "scripts/print_script.ss"
+    });
+  }
+
+  if (fd != OutputConfig::NO_FD) {
+    close(fd);
+  }
+}
+BENCHMARK(printing)
+ ->ArgsProduct({{static_cast<int>(FlushPolicy::LINE), static_cast<int>(FlushPolicy::FULL), static_cast<int>(FlushPolicy::EXIT)}, {0, 1}})
+ ->ArgNames({"policy", "fd"})
+ ->Unit(benchmark::kMillisecond);
+
+static void string_accumulation(benchmark::State& state)
+{
+  std::ostream null(nullptr);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto vm = bench::make_vm(null);
+    vm->set_var("rows", Value(static_cast<Value::NumberType>(state.range(0))));
+    state.ResumeTiming();
+
+    auto result = vm->run_script({
+#include "scripts/string_accumulation_script.ss"
+    });
+    benchmark::DoNotOptimize(result);
+  }
+
+  state.SetComplexityN(state.range(0));
+}
+// 200000 rows of 50 characters is a 10MB string
+BENCHMARK(string_accumulation)->Arg(2000)->Arg(20000)->Arg(200000)->Complexity()->Unit(benchmark::kMillisecond);
+
+static void global_access(benchmark::State& state)
+{
+  run_workload(state, {
+#include "scripts/global_access_script.ss"
+  });
+}
+BENCHMARK(global_access)->Unit(benchmark::kMillisecond);
+
+static void local_access(benchmark::State& state)
+{
+  run_workload(state, {
+#include "scripts/local_access_script.ss"
+  });
+}
+BENCHMARK(local_access)->Unit(benchmark::kMillisecond);
+
+static void native_calls(benchmark::State& state)
+{
+  run_workload(state, {
+#include "scripts/native_call_script.ss"
+  });
+}
+BENCHMARK(native_calls)->Unit(benchmark::kMillisecond);
+
+static void match_table_dispatch(benchmark::State& state)
+{
+  run_workload(state, {
+#include "scripts/match_table_script.ss"
+  });
+}
+BENCHMARK(match_table_dispatch)->Unit(benchmark::kMillisecond);
+
+static void match_linear_dispatch(benchmark::State& state)
+{
+  run_workload(state, {
+#include "scripts/match_linear_script.ss"
+  });
+}
+BENCHMARK(match_linear_dispatch)->Unit(benchmark::kMillisecond);
+
+static void load_heavy_startup(benchmark::State& state)
+{
+  auto dir = std::filesystem::temp_directory_path() / "ss_bench_startup";
+  std::filesystem::create_directories(dir);
+
+  std::stringstream main;
+  for (int i = 0; i < state.range(0); i++) {
+    std::ofstream lib(dir / ("lib_" + std::to_string(i) + ".ss"));
+    lib << "let value_" << i << " = " << i << ";\n";
+    lib << "fn get_" << i << "() { ret value_" << i << "; }\n";
+    lib << "fn twice_" << i << "(x) { ret x + x; }\n";
+    main << "loadr \"lib_" << i << ".ss\";\n";
+  }
+  main << "print get_0();\n";
+
+  std::ostream null(nullptr);
+  auto script = main.str();
+
+  for (auto _ : state) {
+    auto vm     = bench::make_vm(null);
+    auto result = vm->run_script(script, dir / "main.ss");
+    benchmark::DoNotOptimize(result);
+  }
+
+  std::filesystem::remove_all(dir);
+}
+BENCHMARK(load_heavy_startup)->Arg(64)->Unit(benchmark::kMillisecond);
+
+static void host_calls(benchmark::State& state)
+{
+  // an embedder handling events, either by rerunning the script per event or by calling its handler directly
+  constexpr int EVENTS = 10000;
+
+  std::ostream null(nullptr);
+  std::string handler = {
+#include "scripts/handler_script.ss"
+  };
+  bool precompiled = state.range(0);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto vm = bench::make_vm(null);
+    state.ResumeTiming();
+
+    if (precompiled) {
+      vm->run(vm->compile(handler));
+      auto on_event = vm->get_var("on_event");
+      for (int i = 0; i < EVENTS; i++) {
+        auto result = vm->call(on_event, "deposit", static_cast<Value::NumberType>(i));
+        benchmark::DoNotOptimize(result);
+      }
+    } else {
+      // run_script redefines the globals, so every event needs its own vm
+      for (int i = 0; i < EVENTS; i++) {
+        state.PauseTiming();
+        vm = bench::make_vm(null);
+        vm->set_var("amount", Value(static_cast<Value::NumberType>(i)));
+        state.ResumeTiming();
+
+        auto result = vm->run_script(handler + "on_event(\"deposit\", amount);");
+        benchmark::DoNotOptimize(result);
+      }
+    }
+  }
+}
+BENCHMARK(host_calls)->Arg(0)->Arg(1)->ArgName("precompiled")->Unit(benchmark::kMillisecond);
+
+static void pooled_recursion(benchmark::State& state)
+{
+  // every thread checks a vm out per iteration, so this scales with cores as long as vms share nothing
+  static VMPool pool(
+   {
+#include "scripts/fib_script.ss"
+   },
+   [](VM& vm) {
+     vm.set_var("identity", Value(vm.make<NativeFunction>("identity", 1, [](NativeFunction::Args&& args) {
+                  return args[0];
+                })));
+   });
+
+  for (auto _ : state) {
+    auto vm     = pool.acquire();
+    auto result = vm->call(vm->get_var("fib"), 20.0);
+    benchmark::DoNotOptimize(result);
+  }
+}
+BENCHMARK(pooled_recursion)->ThreadRange(1, 8)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+static void test_script(benchmark::State& state)
+{
+  // the repo's own sample script, under each way of dispatching
+  std::ostream null(nullptr);
+  auto script   = ss::util::load_file_to_string(SS_SCRIPTS_DIR "/test_script.ss");
+  auto dispatch = static_cast<Dispatch>(state.range(0));
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    VM vm(VMConfig(&std::cin, &null, OutputConfig(), dispatch));
+    vm.set_var("clock", Value(vm.make<NativeFunction>("clock", 0, [](NativeFunction::Args&&) { return Value(0.0); })));
+    state.ResumeTiming();
+
+    auto result = vm.run_script(script);
+    benchmark::DoNotOptimize(result);
+  }
+}
+BENCHMARK(test_script)
+ ->Arg(static_cast<int>(Dispatch::PLAIN))
+ ->Arg(static_cast<int>(Dispatch::CACHED_TOP))
+ ->Arg(static_cast<int>(Dispatch::TAIL_CALL))
+ ->ArgName("dispatch")
+ ->Unit(benchmark::kMillisecond);
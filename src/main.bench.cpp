@@ -0,0 +1,31 @@
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+  // results are meant to be compared between commits, so report json unless told otherwise
+  std::vector<char*> args(argv, argv + argc);
+  bool has_format = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--benchmark_format", std::strlen("--benchmark_format")) == 0) {
+      has_format = true;
+    }
+  }
+
+  char json[] = "--benchmark_format=json";
+  if (!has_format) {
+    args.push_back(json);
+  }
+
+  int count = static_cast<int>(args.size());
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+    return 1;
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  return 0;
+}
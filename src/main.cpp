@@ -2,19 +2,25 @@
 #include "ss/vm.hpp"
 
 #include <chrono>
+#include <unistd.h>
 
 int main(int argc, char* argv[])
 {
   using ss::CompiletimeError;
+  using ss::FlushPolicy;
   using ss::NativeFunction;
+  using ss::OutputConfig;
   using ss::RuntimeError;
   using ss::Value;
   using ss::VM;
+  using ss::VMConfig;
   using Args = ss::NativeFunction::Args;
 
-  VM vm;
+  // a script's output is buffered & written to stdout directly, while the repl prints each line as it comes
+  VM vm(argc > 1 ? VMConfig(&std::cin, &std::cout, OutputConfig{.flush = FlushPolicy::FULL, .fd = STDOUT_FILENO})
+                 : VMConfig::basic);
 
-  vm.set_var("clock", Value(std::make_shared<NativeFunction>("clock", 0, [](Args&&) {
+  vm.set_var("clock", Value(vm.make<NativeFunction>("clock", 0, [](Args&&) {
                auto tp                                       = std::chrono::high_resolution_clock::now();
                std::chrono::duration<Value::NumberType> secs = tp.time_since_epoch();
                return Value(Value::NumberType{secs.count()});
@@ -1,12 +1,19 @@
 #include "cfg.hpp"
 
+#include <cerrno>
+#include <unistd.h>
+#include <utility>
+
 namespace ss
 {
   VMConfig VMConfig::basic;
 
-  VMConfig::VMConfig(std::istream* is, std::ostream* os)
+  VMConfig::VMConfig(std::istream* is, std::ostream* os, OutputConfig out, Dispatch d, ProfileConfig p)
    : istream(is),
      ostream(os),
+     output(out),
+     dispatch_mode(d),
+     profile_config(std::move(p)),
      istream_initial_state(std::make_shared<std::ios>(nullptr)),
      ostream_initial_state(std::make_shared<std::ios>(nullptr))
   {
@@ -14,6 +21,63 @@ namespace ss
     this->ostream_initial_state->copyfmt(*this->ostream);
   }
 
+  auto VMConfig::dispatch() const noexcept -> Dispatch
+  {
+    return this->dispatch_mode;
+  }
+
+  auto VMConfig::profile() const noexcept -> const ProfileConfig&
+  {
+    return this->profile_config;
+  }
+
+  void VMConfig::print_line(std::string_view text)
+  {
+    this->buffer.append(text);
+    this->buffer.push_back('\n');
+
+    switch (this->output.flush) {
+      case FlushPolicy::LINE: {
+        this->flush();
+      } break;
+      case FlushPolicy::FULL: {
+        if (this->buffer.size() >= this->output.buffer_size) {
+          this->flush();
+        }
+      } break;
+      case FlushPolicy::EXIT:
+        break;
+    }
+  }
+
+  void VMConfig::flush()
+  {
+    if (this->buffer.empty()) {
+      return;
+    }
+
+    if (this->output.fd != OutputConfig::NO_FD) {
+      const char* data = this->buffer.data();
+      std::size_t left = this->buffer.size();
+      while (left > 0) {
+        auto written = ::write(this->output.fd, data, left);
+        if (written < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          // nowhere left to report it, the same as a stream in a failed state
+          break;
+        }
+        data += written;
+        left -= static_cast<std::size_t>(written);
+      }
+    } else if (this->ostream != nullptr) {
+      this->ostream->write(this->buffer.data(), static_cast<std::streamsize>(this->buffer.size()));
+    }
+
+    this->buffer.clear();
+  }
+
   void VMConfig::reset_istream()
   {
     this->istream->copyfmt(*this->istream_initial_state);
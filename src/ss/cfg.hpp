@@ -2,6 +2,8 @@
 
 #include <iostream>
 #include <memory>
+#include <string>
+#include <string_view>
 
 namespace ss
 {
@@ -10,6 +12,10 @@ namespace ss
   constexpr bool PRINT_STACK              = false;
   constexpr bool PRINT_CONSTANTS          = false;
   constexpr bool ECHO_INPUT               = false;
+  /**
+   * @brief Counts and times every dispatched instruction, reporting the totals and hottest lines when a script ends
+   */
+  constexpr bool PROFILE_OPCODES = false;
 
   template <typename T>
   concept Writable = requires(T& t)
@@ -29,17 +35,118 @@ namespace ss
     std::getline(std::cin, t, '\n');
   };
 
+  /**
+   * @brief When printed output is handed from the buffer to the sink
+   */
+  enum class FlushPolicy
+  {
+    /**
+     * @brief After every line, the same as writing straight to the stream
+     */
+    LINE,
+    /**
+     * @brief Whenever the buffer fills, and once the script ends
+     */
+    FULL,
+    /**
+     * @brief Only once the script ends, the buffer growing as much as it needs to until then
+     */
+    EXIT,
+  };
+
+  /**
+   * @brief How the vm moves operands between instructions
+   */
+  enum class Dispatch
+  {
+    /**
+     * @brief Every operand goes through the stack in memory
+     */
+    PLAIN,
+    /**
+     * @brief A number on top of the stack is cached in a local, so chains like LOOKUP_LOCAL, CONSTANT, ADD mostly skip the
+     * stack in memory
+     */
+    CACHED_TOP,
+    /**
+     * @brief Every op code is its own handler function, ending in a tail call to the next one's
+     */
+    TAIL_CALL,
+  };
+
+  struct OutputConfig
+  {
+    static constexpr int NO_FD = -1;
+
+    std::size_t buffer_size = 1 << 14;
+    FlushPolicy flush       = FlushPolicy::LINE;
+
+    /**
+     * @brief When set, output is written to this file descriptor directly, bypassing the ostream
+     */
+    int fd = NO_FD;
+  };
+
+  /**
+   * @brief What the vm records about where a run spends its time
+   */
+  struct ProfileConfig
+  {
+    /**
+     * @brief Times every script and native function call, from the start of a run until it ends
+     */
+    bool functions = false;
+
+    /**
+     * @brief Whether the totals per function are written to the output once the run ends
+     */
+    bool report = false;
+
+    /**
+     * @brief When set, the call stacks are written here in the folded flamegraph format once the run ends
+     */
+    std::ostream* folded = nullptr;
+
+    /**
+     * @brief When set and there is no stream, the call stacks are written to this file instead
+     */
+    std::string folded_path = {};
+  };
+
   class VMConfig
   {
    public:
     static VMConfig basic;
 
-    VMConfig(std::istream* istream = &std::cin, std::ostream* ostream = &std::cout);
+    VMConfig(std::istream* istream = &std::cin,
+     std::ostream* ostream = &std::cout,
+     OutputConfig output   = OutputConfig(),
+     Dispatch dispatch     = Dispatch::CACHED_TOP,
+     ProfileConfig profile = ProfileConfig());
     ~VMConfig() = default;
 
+    auto dispatch() const noexcept -> Dispatch;
+
+    auto profile() const noexcept -> const ProfileConfig&;
+
+    /**
+     * @brief Buffers a line of script output, handing it to the sink as the flush policy says
+     */
+    void print_line(std::string_view text);
+
+    /**
+     * @brief Hands everything buffered to the sink
+     */
+    void flush();
+
     template <Writable... Args>
     void write(Args&&... args)
     {
+      // buffered output came first
+      if (!this->buffer.empty()) {
+        this->flush();
+      }
+
       if (this->ostream != nullptr) {
         (((*this->ostream) << std::forward<Args>(args)), ...);
       }
@@ -54,6 +161,9 @@ namespace ss
     template <Readable T>
     void read(T& t)
     {
+      // whatever prompted for input has to be visible
+      this->flush();
+
       if (this->istream != nullptr) {
         (*istream) >> t;
       }
@@ -62,6 +172,8 @@ namespace ss
     template <LineReadable T>
     void read_line(T& t, char delim = '\n')
     {
+      this->flush();
+
       if (this->istream != nullptr) {
         std::getline(*this->istream, t, delim);
       }
@@ -73,6 +185,10 @@ namespace ss
    private:
     std::istream* istream;
     std::ostream* ostream;
+    OutputConfig output;
+    Dispatch dispatch_mode;
+    ProfileConfig profile_config;
+    std::string buffer;
 
     std::shared_ptr<std::ios> istream_initial_state;
     std::shared_ptr<std::ios> ostream_initial_state;
@@ -1,20 +1,45 @@
 #include "code.hpp"
 
 #include "datatypes.hpp"
+#include "exceptions.hpp"
 #include "util.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <sstream>
+#include <unordered_set>
 
 namespace ss
 {
+  namespace
+  {
+    /**
+     * @brief Tokens take roughly this many bytes per byte of source, sizing the arena so it rarely needs to grow
+     */
+    constexpr std::size_t ARENA_BYTES_PER_SOURCE_BYTE = 10;
+    constexpr std::size_t MIN_ARENA_SIZE              = 4096;
+
+    /**
+     * @brief Slots a stack starts out with, enough that most scripts never grow it
+     */
+    constexpr std::size_t INITIAL_STACK_SIZE = 256;
+  }  // namespace
+
   auto operator<<(std::ostream& ostream, const OpCode& code) -> std::ostream&
   {
     return ostream << to_string(code);
   }
 
+  auto Instruction::operator==(const Instruction& other) const noexcept -> bool
+  {
+    return this->major_opcode == other.major_opcode && this->modifying_bits == other.modifying_bits;
+  }
+
   auto Token::operator==(const Token& other) const noexcept -> bool
   {
     return this->type == other.type && this->lexeme == other.lexeme && this->line == other.line && this->column == other.column;
@@ -31,192 +56,697 @@ namespace ss
                    << ", column: " << token.column << " }";
   }
 
-  void BytecodeChunk::prepare() noexcept
+  auto Program::IdentifierHash::operator()(std::string_view name) const noexcept -> std::size_t
   {
-    this->code.clear();
-    this->constants.clear();
-    this->stack.clear();
-    this->lines.clear();
-    this->last_line            = 0;
-    this->instructions_on_line = 0;
-    this->identifier_cache.clear();
+    return std::hash<std::string_view>{}(name);
   }
 
-  void BytecodeChunk::write(Instruction i, std::size_t line) noexcept
+  auto SourceLocation::operator==(const SourceLocation& other) const noexcept -> bool
+  {
+    return this->line == other.line && this->column == other.column && this->file == other.file;
+  }
+
+  auto JumpTable::offset_for(const Value& value) const noexcept -> std::size_t
+  {
+    switch (value.type()) {
+      case Value::Type::Number: {
+        auto n = value.number();
+        if (!this->dense.empty()) {
+          auto index = n - this->dense_base;
+          if (index >= 0 && index < static_cast<Value::NumberType>(this->dense.size()) && std::floor(index) == index) {
+            auto offset = this->dense[static_cast<std::size_t>(index)];
+            if (offset != 0) {
+              return offset;
+            }
+          }
+        } else if (auto arm = this->numbers.find(n); arm != this->numbers.end()) {
+          return arm->second;
+        }
+      } break;
+      case Value::Type::String: {
+        if (auto arm = this->strings.find(value.string_ref()); arm != this->strings.end()) {
+          return arm->second;
+        }
+      } break;
+      default:
+        break;
+    }
+    return this->default_offset;
+  }
+
+  auto Program::make_function(std::string name, std::size_t airity, std::size_t ip, std::size_t max_stack) -> Function*
+  {
+    this->function_list.push_back(std::make_shared<Function>(std::move(name), airity, ip, max_stack));
+    return this->function_list.back().get();
+  }
+
+  auto Program::functions() const noexcept -> const Functions&
+  {
+    return this->function_list;
+  }
+
+  void Program::write(Instruction i, SourceLocation location) noexcept
   {
     this->code.push_back(std::move(i));
-    this->add_line(line);
+    this->add_location(location);
+  }
+
+  void Program::write(Instruction i, std::size_t line) noexcept
+  {
+    this->write(i, SourceLocation{.line = line});
   }
 
-  void BytecodeChunk::write_constant(Value v, std::size_t line) noexcept
+  void Program::write_constant(Value v, SourceLocation location) noexcept
   {
     this->constants.push_back(std::move(v));
     Instruction i{
      OpCode::CONSTANT,
      this->constants.size() - 1,
     };
-    this->write(i, line);
+    this->write(i, location);
   }
 
-  auto BytecodeChunk::insert_constant(Value v) noexcept -> std::size_t
+  void Program::write_constant(Value v, std::size_t line) noexcept
+  {
+    this->write_constant(std::move(v), SourceLocation{.line = line});
+  }
+
+  auto Program::insert_constant(Value v) noexcept -> std::size_t
   {
     this->constants.push_back(std::move(v));
     return this->constants.size() - 1;
   }
 
-  auto BytecodeChunk::constant_at(std::size_t offset) const noexcept -> Value
+  auto Program::constant_at(std::size_t offset) const noexcept -> Value
   {
     return this->constants[offset];
   }
 
-  void BytecodeChunk::push_stack(Value v) noexcept
+  auto Program::constant_count() const noexcept -> std::size_t
   {
-    this->stack.push_back(std::move(v));
+    return this->constants.size();
   }
 
-  auto BytecodeChunk::pop_stack() noexcept -> Value
+  auto Program::constant_data() const noexcept -> const Value*
   {
-    Value v = this->stack.back();
-    this->stack.pop_back();
-    return v;
+    return this->constants.data();
   }
 
-  void BytecodeChunk::pop_stack_n(std::size_t n)
+  void Program::add_location(SourceLocation location) noexcept
   {
-    this->stack.erase(this->stack.begin() + (this->stack.size() - n), this->stack.end());
+    if (!this->locations.empty()) {
+      const auto& last = this->locations.back();
+      if (last.line == location.line && last.column == location.column && last.file == location.file) {
+        // same location, the current run grows implicitly
+        return;
+      }
+    }
+
+    this->locations.push_back(LocationRun{
+     .offset = static_cast<std::uint32_t>(this->code.size() - 1),
+     .line   = static_cast<std::uint32_t>(location.line),
+     .column = static_cast<std::uint32_t>(location.column),
+     .file   = static_cast<std::uint32_t>(location.file),
+    });
   }
 
-  auto BytecodeChunk::stack_empty() const noexcept -> bool
+  auto Program::line_at(std::size_t offset) const noexcept -> std::size_t
   {
-    return this->stack.empty();
+    return this->location_at(offset).line;
   }
 
-  void BytecodeChunk::add_line(std::size_t line) noexcept
+  auto Program::location_at(std::size_t offset) const noexcept -> SourceLocation
   {
-    if (this->last_line == line) {
-      // same line number
-      this->instructions_on_line += 1;
-    } else {
-      this->lines.push_back(this->instructions_on_line);
-      this->last_line            = line;
-      this->instructions_on_line = 1;  // current instruction
+    // first run starting after the offset, the one before it contains the offset
+    auto run = std::upper_bound(
+     this->locations.begin(), this->locations.end(), offset, [](std::size_t offset, const LocationRun& run) {
+       return offset < run.offset;
+     });
+
+    if (run == this->locations.begin()) {
+      return SourceLocation{};
     }
+
+    run--;
+
+    return SourceLocation{
+     .line   = run->line,
+     .column = run->column,
+     .file   = run->file,
+    };
   }
 
-  auto BytecodeChunk::line_at(std::size_t offset) const noexcept -> std::size_t
+  auto Program::add_file(std::string path) noexcept -> std::size_t
   {
-    std::size_t accum = 0;
-    std::size_t line  = 0;
-    for (const auto num_instructions_on_line : this->lines) {
-      if (accum + num_instructions_on_line > offset) {
-        return line;
-      } else {
-        accum += num_instructions_on_line;
-      }
-      line++;
+    auto file = std::find(this->files.begin(), this->files.end(), path);
+    if (file != this->files.end()) {
+      return file - this->files.begin();
     }
-    return line;
+
+    this->files.push_back(std::move(path));
+    return this->files.size() - 1;
   }
 
-  auto BytecodeChunk::peek_stack(std::size_t index) const noexcept -> Value
+  auto Program::file_name(std::size_t id) const noexcept -> std::string
   {
-    return this->stack[this->stack_size() - 1 - index];
+    if (id < this->files.size()) {
+      return this->files[id];
+    }
+    return std::string();
   }
 
-  auto BytecodeChunk::index_stack(std::size_t index) const noexcept -> Value
+  auto Program::instruction_count() const noexcept -> std::size_t
   {
-    return this->stack[index];
+    return this->code.size();
   }
 
-  auto BytecodeChunk::index_stack_mut(std::size_t index) noexcept -> Value&
+  auto Program::instruction_at(std::size_t index) const noexcept -> InstructionIterator
   {
-    return this->stack[index];
+    return this->code.begin() + index;
   }
 
-  auto BytecodeChunk::stack_size() const noexcept -> std::size_t
+  auto Program::index_code_mut(std::size_t index) -> Instructions::iterator
   {
-    return this->stack.size();
+    return this->code.begin() + index;
   }
 
-  auto BytecodeChunk::instruction_count() const noexcept -> std::size_t
+  void Program::truncate(std::size_t instruction_count) noexcept
   {
-    return this->code.size();
+    if (instruction_count >= this->code.size()) {
+      return;
+    }
+
+    this->code.erase(this->code.begin() + instruction_count, this->code.end());
+    while (!this->locations.empty() && this->locations.back().offset >= instruction_count) { this->locations.pop_back(); }
   }
 
-  auto BytecodeChunk::index_code_mut(std::size_t index) -> InstructionIterator
+  auto Program::checkpoint() const noexcept -> Checkpoint
   {
-    return this->code.begin() + index;
+    return Checkpoint{
+     .code        = this->code.size(),
+     .constants   = this->constants.size(),
+     .jump_tables = this->jump_tables.size(),
+     .locations   = this->locations.size(),
+     .files       = this->files.size(),
+     .functions   = this->function_list.size(),
+    };
   }
 
-  auto BytecodeChunk::begin() noexcept -> InstructionIterator
+  void Program::rollback(const Checkpoint& checkpoint) noexcept
+  {
+    this->code.erase(this->code.begin() + checkpoint.code, this->code.end());
+    this->constants.erase(this->constants.begin() + checkpoint.constants, this->constants.end());
+    this->jump_tables.erase(this->jump_tables.begin() + checkpoint.jump_tables, this->jump_tables.end());
+    // runs are only ever appended, so the ones left are exactly the ones there were
+    this->locations.erase(this->locations.begin() + checkpoint.locations, this->locations.end());
+    this->files.erase(this->files.begin() + checkpoint.files, this->files.end());
+    this->function_list.erase(this->function_list.begin() + checkpoint.functions, this->function_list.end());
+    std::erase_if(this->identifier_cache, [&](const auto& entry) { return entry.second >= checkpoint.constants; });
+  }
+
+  auto Program::begin() const noexcept -> InstructionIterator
   {
     return this->code.begin();
   }
 
-  auto BytecodeChunk::end() noexcept -> InstructionIterator
+  auto Program::end() const noexcept -> InstructionIterator
   {
     return this->code.end();
   }
 
-  auto BytecodeChunk::find_ident(std::string_view name) const noexcept -> IdentifierCacheEntry
+  auto Program::add_jump_table(JumpTable table) noexcept -> std::size_t
+  {
+    this->jump_tables.push_back(std::move(table));
+    return this->jump_tables.size() - 1;
+  }
+
+  auto Program::jump_table_at(std::size_t index) const noexcept -> const JumpTable&
+  {
+    return this->jump_tables[index];
+  }
+
+  auto Program::max_stack_depth(std::size_t entry) const -> std::size_t
+  {
+    return this->walk_stack(entry, false, std::nullopt);
+  }
+
+  void Program::verify(std::size_t entry) const
+  {
+    this->walk_stack(entry, true, std::nullopt);
+    for (const auto& fn : this->function_list) {
+      if (fn->instruction_ptr >= entry) {
+        this->walk_stack(fn->instruction_ptr + 1, true, fn->airity);
+      }
+    }
+  }
+
+  auto Program::walk_stack(std::size_t entry, bool verify, std::optional<std::size_t> airity) const -> std::size_t
+  {
+    // the function, arguments, stack pointer & return address sit below a function's body
+    auto below = static_cast<std::ptrdiff_t>(airity.has_value() ? *airity + 3 : 0);
+    auto size  = this->code.size();
+
+    // the depth each instruction from the entry on was last reached at, the compiler keeps it the same along every path so
+    // each is walked once. Only what follows the entry is tracked, a function's body being the tail of the code when it is made
+    std::vector<std::optional<std::ptrdiff_t>> reached;
+    reached.reserve(size - std::min(entry, size));
+    std::vector<std::pair<std::size_t, std::ptrdiff_t>> paths{{entry, 0}};
+    std::ptrdiff_t max = 0;
+
+    auto require = [verify](bool valid, std::size_t index, const char* problem) {
+      if (verify && !valid) {
+        CompiletimeError::throw_err("invalid bytecode at ", index, ": ", problem);
+      }
+    };
+
+    auto is_call_at = [&](std::size_t index) { return index < size && this->code[index].major_opcode == OpCode::CALL; };
+
+    auto branch = [&](std::size_t from, std::size_t to, std::ptrdiff_t depth) {
+      require(to >= entry && to < size, from, "jumps outside the code");
+      // landing on a call or its return address would skip pushing what the return pops
+      require(!is_call_at(to) && !is_call_at(to + 1), from, "jumps into a call");
+      paths.emplace_back(to, depth);
+    };
+
+    auto is_name = [&](std::size_t index) {
+      return index < this->constants.size() && this->constants[index].is_type(Value::Type::String);
+    };
+
+    while (!paths.empty()) {
+      auto [index, depth] = paths.back();
+      paths.pop_back();
+
+      bool ended = false;
+      while (!ended) {
+        if (index < entry || index >= size) {
+          require(false, index, "runs past the end of the code");
+          break;
+        }
+        if (index - entry >= reached.size()) {
+          reached.resize(index - entry + 1);
+        }
+        auto& seen = reached[index - entry];
+        if (seen.has_value()) {
+          require(*seen == depth, index, "is reached with differing stack depths");
+          if (*seen >= depth) {
+            break;
+          }
+        }
+        seen = depth;
+
+        auto instruction = this->code[index];
+        auto bits        = static_cast<std::ptrdiff_t>(instruction.modifying_bits);
+
+        // the operands an instruction pops must have been pushed within the code being walked
+        auto pop = [&](std::ptrdiff_t count) {
+          require(depth >= count, index, "pops more than was pushed");
+          depth -= count;
+        };
+        // locals may also be what the caller pushed below the body
+        auto local = [&](std::ptrdiff_t slot) { require(slot < below + depth, index, "reaches outside its frame"); };
+
+        switch (instruction.major_opcode) {
+          case OpCode::NO_OP:
+            break;
+          case OpCode::NIL:
+          case OpCode::TRUE:
+          case OpCode::FALSE: {
+            depth++;
+          } break;
+          case OpCode::CONSTANT: {
+            require(instruction.modifying_bits < this->constants.size(), index, "reads a constant that does not exist");
+            depth++;
+          } break;
+          case OpCode::LOOKUP_LOCAL: {
+            local(bits);
+            depth++;
+          } break;
+          case OpCode::ASSIGN_LOCAL: {
+            pop(1);
+            local(bits);
+            depth++;
+          } break;
+          case OpCode::LOOKUP_GLOBAL: {
+            require(is_name(instruction.modifying_bits), index, "names a global with something other than a string");
+            depth++;
+          } break;
+          case OpCode::DEFINE_GLOBAL: {
+            require(is_name(instruction.modifying_bits), index, "names a global with something other than a string");
+            pop(1);
+          } break;
+          case OpCode::ASSIGN_GLOBAL: {
+            require(is_name(instruction.modifying_bits), index, "names a global with something other than a string");
+            pop(1);
+            depth++;
+          } break;
+          case OpCode::ADD_ASSIGN_LOCAL: {
+            pop(1);
+            local(static_cast<std::ptrdiff_t>(add_assign_index(instruction.modifying_bits)));
+            if (add_assign_pushes(instruction.modifying_bits)) {
+              depth++;
+            }
+          } break;
+          case OpCode::ADD_ASSIGN_GLOBAL: {
+            require(is_name(add_assign_index(instruction.modifying_bits)), index, "names a global with something other than a string");
+            pop(1);
+            if (add_assign_pushes(instruction.modifying_bits)) {
+              depth++;
+            }
+          } break;
+          case OpCode::EQUAL:
+          case OpCode::NOT_EQUAL:
+          case OpCode::GREATER:
+          case OpCode::GREATER_EQUAL:
+          case OpCode::LESS:
+          case OpCode::LESS_EQUAL:
+          case OpCode::ADD:
+          case OpCode::SUB:
+          case OpCode::MUL:
+          case OpCode::DIV:
+          case OpCode::MOD: {
+            pop(2);
+            depth++;
+          } break;
+          case OpCode::CHECK:
+          case OpCode::SWAP: {
+            pop(2);
+            depth += 2;
+          } break;
+          case OpCode::NOT:
+          case OpCode::NEGATE: {
+            pop(1);
+            depth++;
+          } break;
+          case OpCode::POP:
+          case OpCode::PRINT: {
+            pop(1);
+          } break;
+          case OpCode::POP_N: {
+            pop(bits);
+          } break;
+          case OpCode::MOVE: {
+            // a bare return moves whatever is on top, which may be the return address
+            require(bits < below + depth, index, "reaches outside its frame");
+          } break;
+          case OpCode::JUMP: {
+            branch(index, index + instruction.modifying_bits, depth);
+            ended = true;
+          } break;
+          case OpCode::LOOP: {
+            branch(index, index - instruction.modifying_bits, depth);
+            ended = true;
+          } break;
+          case OpCode::JUMP_IF_FALSE: {
+            pop(1);
+            depth++;
+            branch(index, index + instruction.modifying_bits, depth);
+          } break;
+          case OpCode::FOR_PREP: {
+            pop(3);
+            depth += 3;
+            branch(index, index + for_loop_offset(instruction.modifying_bits), depth);
+          } break;
+          case OpCode::FOR_LOOP: {
+            pop(3);
+            depth += 3;
+            branch(index, index - for_loop_offset(instruction.modifying_bits), depth);
+          } break;
+          case OpCode::OR:
+          case OpCode::AND: {
+            // the jump keeps the operand, falling through pops it
+            pop(1);
+            branch(index, index + instruction.modifying_bits, depth + 1);
+          } break;
+          case OpCode::MATCH_TABLE: {
+            require(instruction.modifying_bits < this->jump_tables.size(), index, "uses a jump table that does not exist");
+            pop(1);
+            depth++;
+            if (instruction.modifying_bits < this->jump_tables.size()) {
+              const auto& table = this->jump_tables[instruction.modifying_bits];
+              for (auto offset : table.dense) {
+                if (offset != 0) {
+                  branch(index, index + offset, depth);
+                }
+              }
+              for (const auto& [_, offset] : table.numbers) { branch(index, index + offset, depth); }
+              for (const auto& [_, offset] : table.strings) { branch(index, index + offset, depth); }
+              branch(index, index + table.default_offset, depth);
+            }
+            ended = true;
+          } break;
+          case OpCode::PUSH_SP: {
+            // the function & its arguments
+            require(depth >= bits + 1, index, "pops more than was pushed");
+            depth++;
+          } break;
+          case OpCode::CALL: {
+            // only what the compiler emits leaves addresses where the return expects them
+            bool framed = index >= 2 && this->code[index - 2] == Instruction{OpCode::PUSH_SP, instruction.modifying_bits} &&
+                          this->code[index - 1].major_opcode == OpCode::CONSTANT &&
+                          this->code[index - 1].modifying_bits < this->constants.size() &&
+                          this->constants[this->code[index - 1].modifying_bits].is_type(Value::Type::Address) &&
+                          this->constants[this->code[index - 1].modifying_bits].address().ptr == index + 1;
+            require(framed, index, "calls without pushing a stack pointer & return address first");
+            // the function, arguments, stack pointer & return address are replaced by the return value
+            pop(bits + 3);
+            depth++;
+          } break;
+          case OpCode::RETURN: {
+            require(airity.has_value(), index, "returns outside of a function");
+            require(depth == 1 && airity == instruction.modifying_bits, index, "returns with a different frame than it entered");
+            ended = true;
+          } break;
+          case OpCode::END: {
+            require(!airity.has_value(), index, "ends the script inside a function");
+            ended = true;
+          } break;
+          default: {
+            require(false, index, "is not an op code");
+          } break;
+        }
+
+        max = std::max(max, depth);
+        if (!ended) {
+          index++;
+        }
+      }
+    }
+
+    return static_cast<std::size_t>(max);
+  }
+
+  auto Program::find_ident(std::string_view name) const noexcept -> IdentifierCacheEntry
   {
     return this->identifier_cache.find(name);
   }
 
-  auto BytecodeChunk::is_entry_found(IdentifierCacheEntry entry) const noexcept -> bool
+  auto Program::is_entry_found(IdentifierCacheEntry entry) const noexcept -> bool
   {
     return entry != this->identifier_cache.end();
   }
 
-  auto BytecodeChunk::add_ident(std::string_view name) noexcept -> std::size_t
+  auto Program::add_ident(std::string_view name) noexcept -> std::size_t
   {
-    auto indx                    = this->insert_constant(Value(std::string(name)));
-    this->identifier_cache[name] = indx;
+    auto indx = this->insert_constant(Value(Value::StringType(name)));
+    // the key must own its characters, the source text the name was scanned from does not outlive the compile
+    this->identifier_cache.emplace(std::string(name), indx);
     return indx;
   }
 
-  void BytecodeChunk::set_global(Value::StringType&& name, Value value) noexcept
+  void Program::print_constants(VMConfig& cfg) const noexcept
+  {
+    cfg.write_line("CONSTANTS");
+    for (std::size_t i = 0; i < this->constants.size(); i++) { cfg.write_line(i, "=", this->constant_at(i)); }
+  }
+
+  ExecutionContext::ExecutionContext(HeapConfig heap_config)
+   : heap(heap_config)
+   , stack(std::allocator<Value>().allocate(INITIAL_STACK_SIZE))
+   , capacity(INITIAL_STACK_SIZE)
+   , top(0)
+  {}
+
+  ExecutionContext::~ExecutionContext()
+  {
+    std::destroy_n(this->stack, this->top);
+    std::allocator<Value>().deallocate(this->stack, this->capacity);
+  }
+
+  void ExecutionContext::prepare() noexcept
   {
-    this->globals[name] = value;
+    this->pop_stack_n(this->top);
   }
 
-  auto BytecodeChunk::find_global(Value::StringType name) noexcept -> GlobalMap::iterator
+  void ExecutionContext::retain_functions(const Program& program)
+  {
+    std::unordered_set<const Function*> referenced;
+    auto reference = [&referenced](const Value& value) {
+      if (value.is_type(Value::Type::Function)) {
+        referenced.insert(value.function());
+      }
+    };
+    for (std::size_t i = 0; i < this->top; i++) { reference(this->stack[i]); }
+    for (const auto& [_, value] : this->globals) { reference(value); }
+
+    std::erase_if(this->retained, [&referenced](const auto& fn) { return !referenced.contains(fn.get()); });
+    for (const auto& fn : program.functions()) {
+      if (referenced.contains(fn.get())) {
+        this->retained.push_back(fn);
+      }
+    }
+  }
+
+  void ExecutionContext::push_stack(Value v) noexcept
+  {
+    if (this->top == this->capacity) {
+      this->grow_stack();
+    }
+    std::construct_at(this->stack + this->top++, std::move(v));
+  }
+
+  auto ExecutionContext::pop_stack() noexcept -> Value
+  {
+    Value v = std::move(this->stack[--this->top]);
+    std::destroy_at(this->stack + this->top);
+    return v;
+  }
+
+  void ExecutionContext::pop_stack_n(std::size_t n)
+  {
+    this->top -= n;
+    std::destroy_n(this->stack + this->top, n);
+  }
+
+  auto ExecutionContext::stack_empty() const noexcept -> bool
+  {
+    return this->top == 0;
+  }
+
+  auto ExecutionContext::peek_stack(std::size_t index) const noexcept -> Value
+  {
+    return this->stack[this->top - 1 - index];
+  }
+
+  auto ExecutionContext::index_stack(std::size_t index) const noexcept -> Value
+  {
+    return this->stack[index];
+  }
+
+  auto ExecutionContext::index_stack_mut(std::size_t index) noexcept -> Value&
+  {
+    return this->stack[index];
+  }
+
+  auto ExecutionContext::stack_size() const noexcept -> std::size_t
+  {
+    return this->top;
+  }
+
+  auto ExecutionContext::stack_base() noexcept -> Value*
+  {
+    return this->stack;
+  }
+
+  auto ExecutionContext::stack_top() noexcept -> Value*
+  {
+    return this->stack + this->top;
+  }
+
+  auto ExecutionContext::stack_limit() noexcept -> Value*
+  {
+    return this->stack + this->capacity;
+  }
+
+  void ExecutionContext::set_stack_top(Value* t) noexcept
+  {
+    this->top = t - this->stack;
+  }
+
+  void ExecutionContext::grow_stack()
+  {
+    std::allocator<Value> allocator;
+    auto capacity = this->capacity * 2;
+    auto stack    = allocator.allocate(capacity);
+
+    std::uninitialized_move_n(this->stack, this->top, stack);
+    std::destroy_n(this->stack, this->top);
+    allocator.deallocate(this->stack, this->capacity);
+
+    this->stack    = stack;
+    this->capacity = capacity;
+  }
+
+  void ExecutionContext::reserve_stack(std::size_t room)
+  {
+    while (this->capacity - this->top < room) { this->grow_stack(); }
+  }
+
+  void ExecutionContext::collect_garbage()
+  {
+    this->heap.collect([this](Heap& heap) {
+      for (std::size_t i = 0; i < this->top; i++) { heap.mark(this->stack[i]); }
+      for (const auto& [_, value] : this->globals) { heap.mark(value); }
+    });
+  }
+
+  auto ExecutionContext::string_resource() -> std::pmr::memory_resource*
+  {
+    if (this->heap.should_collect_nursery()) {
+      this->heap.collect_nursery([this](Heap& heap) {
+        for (std::size_t i = 0; i < this->top; i++) { heap.promote(this->stack[i]); }
+        for (auto& [_, value] : this->globals) { heap.promote(value); }
+      });
+    }
+    return this->heap.string_resource();
+  }
+
+  void ExecutionContext::promote(Value& value)
+  {
+    this->heap.promote(value);
+  }
+
+  auto ExecutionContext::heap_stats() const noexcept -> const HeapStats&
+  {
+    return this->heap.statistics();
+  }
+
+  void ExecutionContext::set_global(Value::StringType&& name, Value value) noexcept
+  {
+    this->globals[name] = std::move(value);
+  }
+
+  auto ExecutionContext::find_global(Value::StringType name) noexcept -> GlobalMap::iterator
   {
     return this->globals.find(name);
   }
 
-  auto BytecodeChunk::is_global_found(GlobalMap::iterator it) const noexcept -> bool
+  auto ExecutionContext::is_global_found(GlobalMap::iterator it) const noexcept -> bool
   {
     return it != this->globals.end();
   }
 
-  void BytecodeChunk::print_stack(VMConfig& cfg) const noexcept
+  void ExecutionContext::print_stack(VMConfig& cfg) const noexcept
   {
     cfg.write("        | ");
     if (this->stack_empty()) {
       cfg.write_line("[ ]");
     } else {
-      for (const auto& value : this->stack) { cfg.write("[ ", value.to_string(), " ]"); }
+      for (std::size_t i = 0; i < this->top; i++) { cfg.write("[ ", this->stack[i].to_string(), " ]"); }
       cfg.write_line();
     }
   }
 
-  void BytecodeChunk::print_constants(VMConfig& cfg) const noexcept
-  {
-    cfg.write_line("CONSTANTS");
-    for (std::size_t i = 0; i < this->constants.size(); i++) { cfg.write_line(i, "=", this->constant_at(i)); }
-  }
-
-  Scanner::Scanner(std::string&& src) noexcept
+  Scanner::Scanner(std::string&& src, std::pmr::memory_resource* r) noexcept
    : source(std::move(src))
+   , resource(r)
    , current_char(this->source.begin())
    , line(1)
    , column(1)
   {}
 
-  auto Scanner::scan() -> std::vector<Token>
+  auto Scanner::scan() -> std::pmr::vector<Token>
   {
-    std::vector<Token> tokens;
+    std::pmr::vector<Token> tokens(this->resource);
 
     for (this->skip_whitespace(); !this->is_at_end(); this->skip_whitespace()) {
       char c = *this->starting_char;
@@ -554,20 +1084,47 @@ namespace ss
     return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '@';
   }
 
-  Parser::Parser(TokenList&& t, BytecodeChunk& c, std::string cf) noexcept
+  Parser::Parser(TokenList&& t, Program& p, std::string cf, LibraryPaths lp) noexcept
    : tokens(std::move(t))
    , iter(this->tokens.begin())
-   , chunk(c)
+   , program(p)
    , current_file(cf)
+   , file_id(p.add_file(cf))
+   , library_paths(std::move(lp))
+   , arena(this->tokens.get_allocator().resource())
+   , locals(this->arena)
    , scope_depth(0)
    , in_loop(false)
+   , continues(this->arena)
+   , breaks(this->arena)
+   , in_function(false)
+   , reachable(true)
   {}
 
   void Parser::parse()
+  {
+    this->parse_declarations();
+    if (this->reachable) {
+      this->emit_constant(Value{});
+      this->emit_instruction(Instruction{OpCode::END});
+    }
+  }
+
+  void Parser::parse_declarations()
   {
     while (this->iter < tokens.end() && this->iter->type != Token::Type::END_OF_FILE) { this->declaration(); }
-    this->emit_constant(Value{});
-    this->emit_instruction(Instruction{OpCode::END});
+  }
+
+  void Parser::load_file(std::string path)
+  {
+    // tokens view into the contents, so it must outlive the parser
+    auto contents = util::load_file_to_string(path);
+
+    Scanner scanner(std::move(contents), this->arena);
+
+    // loaded files are inlined, terminating the program here would end the script at the load statement
+    Parser parser(scanner.scan(), this->program, path, this->library_paths);
+    parser.parse_declarations();
   }
 
   auto Parser::previous() const -> TokenIterator
@@ -575,12 +1132,21 @@ namespace ss
     return this->iter - 1;
   }
 
+  auto Parser::location_of(TokenIterator tok) const noexcept -> SourceLocation
+  {
+    return SourceLocation{
+     .line   = tok->line,
+     .column = tok->column,
+     .file   = this->file_id,
+    };
+  }
+
   void Parser::advance() noexcept
   {
     this->iter++;
   }
 
-  void Parser::consume(Token::Type type, std::string err)
+  void Parser::consume(Token::Type type, const char* err)
   {
     if (this->iter->type == type) {
       this->advance();
@@ -591,26 +1157,26 @@ namespace ss
 
   void Parser::emit_instruction(Instruction i)
   {
-    this->chunk.write(i, this->previous()->line);
+    this->program.write(i, this->location_of(this->previous()));
   }
 
   void Parser::emit_constant(Value v)
   {
-    this->chunk.write_constant(v, this->previous()->line);
+    this->program.write_constant(v, this->location_of(this->previous()));
   }
 
   auto Parser::emit_jump(Instruction i) -> std::size_t
   {
-    std::size_t location = this->chunk.instruction_count();
+    std::size_t location = this->program.instruction_count();
     this->emit_instruction(i);
     return location;
   }
 
   void Parser::patch_jump(std::size_t jump_loc)
   {
-    std::size_t offset = this->chunk.instruction_count() - jump_loc;
+    std::size_t offset = this->program.instruction_count() - jump_loc;
 
-    this->chunk.index_code_mut(jump_loc)->modifying_bits = offset;
+    this->program.index_code_mut(jump_loc)->modifying_bits = offset;
   }
 
   void Parser::wrap_scope(auto f)
@@ -632,7 +1198,7 @@ namespace ss
       count++;
     }
 
-    if (count > 0) {
+    if (count > 0 && this->reachable) {
       this->emit_instruction(Instruction{OpCode::POP_N, count});
     }
   }
@@ -670,15 +1236,16 @@ namespace ss
     this->locals_in_function = old_locals_in_function;
   }
 
-  void Parser::wrap_loop(std::size_t cont_jmp, auto f)
+  void Parser::wrap_loop(std::optional<std::size_t> cont_jmp, auto f)
   {
-    auto old_in_loop   = this->in_loop;
-    auto old_depth     = this->loop_depth;
-    auto old_breaks    = std::move(this->breaks);
-    auto old_continue  = this->continue_jmp;
-    this->in_loop      = true;
-    this->continue_jmp = cont_jmp;
-    this->loop_depth   = this->scope_depth;
+    auto old_in_loop    = this->in_loop;
+    auto old_depth      = this->loop_depth;
+    auto old_breaks     = std::move(this->breaks);
+    auto old_continue   = this->continue_jmp;
+    auto old_continues  = std::move(this->continues);
+    this->in_loop       = true;
+    this->continue_jmp  = cont_jmp;
+    this->loop_depth    = this->scope_depth;
 
     f();
 
@@ -686,79 +1253,127 @@ namespace ss
     this->loop_depth   = old_depth;
     this->breaks       = std::move(old_breaks);
     this->continue_jmp = old_continue;
+    this->continues    = std::move(old_continues);
   }
 
-  auto Parser::rule_for(Token::Type t) const noexcept -> const ParseRule&
-  {
-    static const std::array<ParseRule, static_cast<std::size_t>(Token::Type::LAST)> rules = [this] {
-      std::array<ParseRule, static_cast<std::size_t>(Token::Type::LAST)> rules{};
-      rules[static_cast<std::size_t>(Token::Type::LEFT_PAREN)] = {&Parser::grouping_expr, &Parser::call_expr, Precedence::CALL};
-      rules[static_cast<std::size_t>(Token::Type::RIGHT_PAREN)] = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::LEFT_BRACE)]  = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::RIGHT_BRACE)] = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::COMMA)]       = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::DOT)]         = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::SEMICOLON)]   = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::PLUS)]        = {nullptr, &Parser::binary_expr, Precedence::TERM};
-      rules[static_cast<std::size_t>(Token::Type::MINUS)]       = {&Parser::unary_expr, &Parser::binary_expr, Precedence::TERM};
-      rules[static_cast<std::size_t>(Token::Type::STAR)]        = {nullptr, &Parser::binary_expr, Precedence::FACTOR};
-      rules[static_cast<std::size_t>(Token::Type::SLASH)]       = {nullptr, &Parser::binary_expr, Precedence::FACTOR};
-      rules[static_cast<std::size_t>(Token::Type::MODULUS)]     = {nullptr, &Parser::binary_expr, Precedence::FACTOR};
-      rules[static_cast<std::size_t>(Token::Type::BANG)]        = {&Parser::unary_expr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::BANG_EQUAL)]  = {nullptr, &Parser::binary_expr, Precedence::EQUALITY};
-      rules[static_cast<std::size_t>(Token::Type::EQUAL)]       = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::EQUAL_EQUAL)] = {nullptr, &Parser::binary_expr, Precedence::EQUALITY};
-      rules[static_cast<std::size_t>(Token::Type::GREATER)]     = {nullptr, &Parser::binary_expr, Precedence::COMPARISON};
-      rules[static_cast<std::size_t>(Token::Type::GREATER_EQUAL)] = {nullptr, &Parser::binary_expr, Precedence::COMPARISON};
-      rules[static_cast<std::size_t>(Token::Type::LESS)]          = {nullptr, &Parser::binary_expr, Precedence::COMPARISON};
-      rules[static_cast<std::size_t>(Token::Type::LESS_EQUAL)]    = {nullptr, &Parser::binary_expr, Precedence::COMPARISON};
-      rules[static_cast<std::size_t>(Token::Type::ARROW)]         = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::IDENTIFIER)]    = {&Parser::make_variable, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::STRING)]        = {&Parser::make_string, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::NUMBER)]        = {&Parser::make_number, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::AND)]           = {nullptr, &Parser::and_expr, Precedence::AND};
-      rules[static_cast<std::size_t>(Token::Type::BREAK)]         = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::CLASS)]         = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::CONTINUE)]      = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::ELSE)]          = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::FALSE)]         = {&Parser::literal_expr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::FOR)]           = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::FN)]            = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::IF)]            = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::LOAD)]          = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::LOADR)]         = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::LOOP)]          = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::MATCH)]         = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::NIL)]           = {&Parser::literal_expr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::OR)]            = {nullptr, &Parser::or_expr, Precedence::OR};
-      rules[static_cast<std::size_t>(Token::Type::PRINT)]         = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::RETURN)]        = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::TRUE)]          = {&Parser::literal_expr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::LET)]           = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::WHILE)]         = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::ERROR)]         = {nullptr, nullptr, Precedence::NONE};
-      rules[static_cast<std::size_t>(Token::Type::END_OF_FILE)]   = {nullptr, nullptr, Precedence::NONE};
-      return rules;
-    }();
+  void Parser::discard(auto f)
+  {
+    auto old_reachable = this->reachable;
+    auto code_size     = this->program.instruction_count();
+    auto break_count    = this->breaks.size();
+    auto continue_count = this->continues.size();
+    this->reachable     = true;
+
+    f();
+
+    // jumps recorded inside the discarded code would otherwise be patched over whatever gets emitted there next
+    this->program.truncate(code_size);
+    this->breaks.resize(break_count);
+    this->continues.resize(continue_count);
+    this->reachable = old_reachable;
+  }
 
+  auto Parser::fold_condition(std::size_t start) -> std::optional<bool>
+  {
+    if (this->program.instruction_count() != start + 1) {
+      return std::nullopt;
+    }
+
+    std::optional<bool> truthy;
+    auto instruction = this->program.index_code_mut(start);
+    switch (instruction->major_opcode) {
+      case OpCode::TRUE: {
+        truthy = true;
+      } break;
+      case OpCode::FALSE:
+      case OpCode::NIL: {
+        truthy = false;
+      } break;
+      case OpCode::CONSTANT: {
+        truthy = this->program.constant_at(instruction->modifying_bits).truthy();
+      } break;
+      default:
+        break;
+    }
+
+    if (truthy.has_value()) {
+      this->program.truncate(start);
+    }
+
+    return truthy;
+  }
+
+  constexpr Parser::ParseRuleTable Parser::rules = [] {
+    ParseRuleTable rules{};
+    rules[static_cast<std::size_t>(Token::Type::LEFT_PAREN)] = {&Parser::grouping_expr, &Parser::call_expr, Precedence::CALL};
+    rules[static_cast<std::size_t>(Token::Type::RIGHT_PAREN)] = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::LEFT_BRACE)]  = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::RIGHT_BRACE)] = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::COMMA)]       = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::DOT)]         = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::SEMICOLON)]   = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::PLUS)]        = {nullptr, &Parser::binary_expr, Precedence::TERM};
+    rules[static_cast<std::size_t>(Token::Type::MINUS)]       = {&Parser::unary_expr, &Parser::binary_expr, Precedence::TERM};
+    rules[static_cast<std::size_t>(Token::Type::STAR)]        = {nullptr, &Parser::binary_expr, Precedence::FACTOR};
+    rules[static_cast<std::size_t>(Token::Type::SLASH)]       = {nullptr, &Parser::binary_expr, Precedence::FACTOR};
+    rules[static_cast<std::size_t>(Token::Type::MODULUS)]     = {nullptr, &Parser::binary_expr, Precedence::FACTOR};
+    rules[static_cast<std::size_t>(Token::Type::BANG)]        = {&Parser::unary_expr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::BANG_EQUAL)]  = {nullptr, &Parser::binary_expr, Precedence::EQUALITY};
+    rules[static_cast<std::size_t>(Token::Type::EQUAL)]       = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::EQUAL_EQUAL)] = {nullptr, &Parser::binary_expr, Precedence::EQUALITY};
+    rules[static_cast<std::size_t>(Token::Type::GREATER)]     = {nullptr, &Parser::binary_expr, Precedence::COMPARISON};
+    rules[static_cast<std::size_t>(Token::Type::GREATER_EQUAL)] = {nullptr, &Parser::binary_expr, Precedence::COMPARISON};
+    rules[static_cast<std::size_t>(Token::Type::LESS)]          = {nullptr, &Parser::binary_expr, Precedence::COMPARISON};
+    rules[static_cast<std::size_t>(Token::Type::LESS_EQUAL)]    = {nullptr, &Parser::binary_expr, Precedence::COMPARISON};
+    rules[static_cast<std::size_t>(Token::Type::ARROW)]         = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::IDENTIFIER)]    = {&Parser::make_variable, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::STRING)]        = {&Parser::make_string, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::NUMBER)]        = {&Parser::make_number, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::AND)]           = {nullptr, &Parser::and_expr, Precedence::AND};
+    rules[static_cast<std::size_t>(Token::Type::BREAK)]         = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::CLASS)]         = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::CONTINUE)]      = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::ELSE)]          = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::FALSE)]         = {&Parser::literal_expr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::FOR)]           = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::FN)]            = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::IF)]            = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::LOAD)]          = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::LOADR)]         = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::LOOP)]          = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::MATCH)]         = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::NIL)]           = {&Parser::literal_expr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::OR)]            = {nullptr, &Parser::or_expr, Precedence::OR};
+    rules[static_cast<std::size_t>(Token::Type::PRINT)]         = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::RETURN)]        = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::TRUE)]          = {&Parser::literal_expr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::LET)]           = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::WHILE)]         = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::ERROR)]         = {nullptr, nullptr, Precedence::NONE};
+    rules[static_cast<std::size_t>(Token::Type::END_OF_FILE)]   = {nullptr, nullptr, Precedence::NONE};
+    return rules;
+  }();
+
+  auto Parser::rule_for(Token::Type t) noexcept -> const ParseRule&
+  {
     return rules[static_cast<std::size_t>(t)];
   }
 
   void Parser::parse_precedence(Precedence precedence)
   {
     this->advance();
-    ParseFn prefix_rule = this->rule_for(this->previous()->type).prefix;
+    ParseFn prefix_rule = rule_for(this->previous()->type).prefix;
     if (prefix_rule == nullptr) {
       this->error(this->previous(), "expected an expression");
     }
 
     bool can_assign = precedence <= Precedence::ASSIGNMENT;
-    prefix_rule(this, can_assign);
+    (this->*prefix_rule)(can_assign);
 
-    while (precedence <= this->rule_for(this->iter->type).precedence) {
+    while (precedence <= rule_for(this->iter->type).precedence) {
       this->advance();
-      ParseFn infix_rule = this->rule_for(this->previous()->type).infix;
-      infix_rule(this, can_assign);
+      ParseFn infix_rule = rule_for(this->previous()->type).infix;
+      (this->*infix_rule)(can_assign);
     }
 
     if (can_assign && this->advance_if_matches(Token::Type::EQUAL)) {
@@ -768,25 +1383,17 @@ namespace ss
 
   void Parser::make_number(bool)
   {
-    auto lexeme = this->previous()->lexeme;
-
-    const char* begin = lexeme.data();
-
-    // TODO when gcc finally has from_chars support for non-integrals
-    char* end = const_cast<char*>(lexeme.data()) + lexeme.size();
-
-    Value v = std::strtod(begin, &end);
-
-    if (end == begin) {
+    Value::NumberType number;
+    if (!util::parse_number(this->previous()->lexeme, number)) {
       this->error(this->previous(), "unparsable number");
     }
 
-    this->emit_constant(v);
+    this->emit_constant(Value(number));
   }
 
   void Parser::make_string(bool)
   {
-    Value v(std::string(this->previous()->lexeme));
+    Value v(Value::StringType(this->previous()->lexeme));
     this->emit_constant(v);
   }
 
@@ -825,23 +1432,31 @@ namespace ss
       return_addr.initialized = false;
       this->locals.push_back(return_addr);
 
+      auto old_reachable = this->reachable;
+      this->reachable    = true;
+
       this->wrap_call_block(airity, [&] { this->fn_block_stmt(); });
 
       auto count = this->reduce_locals_to_depth(this->scope_depth);
-      if (count > 0) {
-        this->emit_instruction(Instruction{OpCode::POP_N, count});
+
+      // implicit return, unnecessary if every path through the body already returned
+      if (this->reachable) {
+        if (count > 0) {
+          this->emit_instruction(Instruction{OpCode::POP_N, count});
+        }
+
+        this->emit_instruction(Instruction{OpCode::NIL});
+        this->emit_instruction(Instruction{OpCode::RETURN, airity});
       }
 
-      // implicit return
-      this->emit_instruction(Instruction{OpCode::NIL});
-      this->emit_instruction(Instruction{OpCode::RETURN, airity});
+      this->reachable = old_reachable;
 
       this->locals.pop_back();
       this->locals.pop_back();
     });
 
     this->patch_jump(end_jmp);
-    this->emit_constant(Value{std::make_shared<Function>(name, airity, end_jmp)});
+    this->emit_constant(Value{this->program.make_function(name, airity, end_jmp, this->program.max_stack_depth(end_jmp + 1))});
   }
 
   void Parser::named_variable(TokenIterator name, bool can_assign)
@@ -864,14 +1479,24 @@ namespace ss
     }
 
     if (can_assign && this->advance_if_matches(Token::Type::EQUAL)) {
-      this->expression();
-      this->emit_instruction(Instruction{set, index});
+      bool global = lookup.type == VarLookup::Type::GLOBAL;
+      if (this->is_in_place_add(name, global)) {
+        // skip past the variable & '+', only the operand is evaluated
+        this->advance();
+        this->advance();
+        this->parse_precedence(Precedence::FACTOR);
+        this->emit_instruction(
+         Instruction{global ? OpCode::ADD_ASSIGN_GLOBAL : OpCode::ADD_ASSIGN_LOCAL, add_assign_bits(index, true)});
+      } else {
+        this->expression();
+        this->emit_instruction(Instruction{set, index});
+      }
     } else {
       this->emit_instruction(Instruction{get, index});
     }
   }
 
-  auto Parser::parse_variable(std::string err_msg) -> std::size_t
+  auto Parser::parse_variable(const char* err_msg) -> std::size_t
   {
     this->consume(Token::Type::IDENTIFIER, err_msg);
     this->declare_variable();
@@ -919,11 +1544,11 @@ namespace ss
 
   auto Parser::identifier_constant(TokenIterator name) -> std::size_t
   {
-    auto entry = this->chunk.find_ident(name->lexeme);
-    if (this->chunk.is_entry_found(entry)) {
+    auto entry = this->program.find_ident(name->lexeme);
+    if (this->program.is_entry_found(entry)) {
       return entry->second;
     } else {
-      return this->chunk.add_ident(name->lexeme);
+      return this->program.add_ident(name->lexeme);
     }
   }
 
@@ -982,6 +1607,30 @@ namespace ss
     return count;
   }
 
+  auto Parser::locals_above_depth(std::size_t depth) const noexcept -> std::size_t
+  {
+    std::size_t count = 0;
+    for (auto local = this->locals.rbegin(); local != this->locals.rend() && local->depth > depth; local++) { count++; }
+    return count;
+  }
+
+  void Parser::effect_expression()
+  {
+    bool assignment = this->check(Token::Type::IDENTIFIER) && (this->iter + 1)->type == Token::Type::EQUAL;
+
+    this->expression();
+
+    // an assignment is the entire expression, so its instruction is the last and nothing else reads the result
+    auto last = this->program.index_code_mut(this->program.instruction_count() - 1);
+    if (
+     assignment &&
+     (last->major_opcode == OpCode::ADD_ASSIGN_LOCAL || last->major_opcode == OpCode::ADD_ASSIGN_GLOBAL)) {
+      last->modifying_bits = add_assign_bits(add_assign_index(last->modifying_bits), false);
+    } else {
+      this->emit_instruction(Instruction{OpCode::POP});
+    }
+  }
+
   void Parser::expression()
   {
     this->parse_precedence(Precedence::ASSIGNMENT);
@@ -1015,7 +1664,7 @@ namespace ss
   {
     Token::Type operator_type = this->previous()->type;
 
-    const ParseRule& rule = this->rule_for(operator_type);
+    const ParseRule& rule = rule_for(operator_type);
     this->parse_precedence(static_cast<Precedence>(static_cast<std::size_t>(rule.precedence) + 1));
 
     switch (operator_type) {
@@ -1096,7 +1745,7 @@ namespace ss
   {
     std::size_t arg_count = this->parse_arg_list();
     this->emit_instruction(Instruction{OpCode::PUSH_SP, arg_count});
-    this->emit_constant(Value{Value::AddressType{this->chunk.instruction_count() + 2}});
+    this->emit_constant(Value{Value::AddressType{this->program.instruction_count() + 2}});
     this->emit_instruction(Instruction{OpCode::CALL, arg_count});
   }
 
@@ -1167,6 +1816,12 @@ namespace ss
 
   void Parser::declaration()
   {
+    if (!this->reachable) {
+      // nothing after a ret, break, cont, or end in the same block can ever run
+      this->discard([&] { this->declaration(); });
+      return;
+    }
+
     if (this->advance_if_matches(Token::Type::LET)) {
       this->let_stmt();
     } else {
@@ -1183,9 +1838,8 @@ namespace ss
 
   void Parser::expression_stmt()
   {
-    this->expression();
+    this->effect_expression();
     this->consume(Token::Type::SEMICOLON, "expected ';' after value");
-    this->emit_instruction(Instruction{OpCode::POP});
   }
 
   void Parser::let_stmt()
@@ -1220,14 +1874,38 @@ namespace ss
 
   void Parser::if_stmt()
   {
+    std::size_t condition_start = this->program.instruction_count();
     this->expression();
     this->consume(Token::Type::LEFT_BRACE, "expect '{' after condition");
 
+    auto folded = this->fold_condition(condition_start);
+    if (folded.has_value()) {
+      if (*folded) {
+        this->block_stmt();
+        if (this->advance_if_matches(Token::Type::ELSE)) {
+          this->discard([&] { this->statement(); });
+        }
+      } else {
+        this->discard([&] { this->block_stmt(); });
+        if (this->advance_if_matches(Token::Type::ELSE)) {
+          this->statement();
+        }
+      }
+      return;
+    }
+
     std::size_t jump_location = this->emit_jump(Instruction{OpCode::JUMP_IF_FALSE});
     this->emit_instruction(Instruction{OpCode::POP});
     this->block_stmt();
 
-    std::size_t else_location = this->emit_jump(Instruction{OpCode::JUMP});
+    bool then_reachable = this->reachable;
+    this->reachable     = true;
+
+    // no need to jump over the else branch if the then branch never finishes
+    std::size_t else_location = 0;
+    if (then_reachable) {
+      else_location = this->emit_jump(Instruction{OpCode::JUMP});
+    }
     this->patch_jump(jump_location);
     this->emit_instruction(Instruction{OpCode::POP});
 
@@ -1235,43 +1913,81 @@ namespace ss
       this->statement();
     }
 
-    this->patch_jump(else_location);
+    if (then_reachable) {
+      this->patch_jump(else_location);
+    }
+
+    this->reachable = this->reachable || then_reachable;
   }
 
   void Parser::loop_stmt()
   {
-    std::size_t loop_start = this->chunk.instruction_count();
+    std::size_t loop_start = this->program.instruction_count();
     this->consume(Token::Type::LEFT_BRACE, "expect '{' after loop keyword");
     this->wrap_loop(loop_start, [&] {
       this->block_stmt();
-      this->emit_instruction(Instruction{OpCode::LOOP, this->chunk.instruction_count() - loop_start});
+      if (this->reachable) {
+        this->emit_instruction(Instruction{OpCode::LOOP, this->program.instruction_count() - loop_start});
+      }
       for (const auto jmp : this->breaks) { this->patch_jump(jmp); }
+
+      // only a break gets out of a loop
+      this->reachable = !this->breaks.empty();
     });
   }
 
   void Parser::while_stmt()
   {
-    std::size_t loop_start = this->chunk.instruction_count();
+    std::size_t loop_start = this->program.instruction_count();
 
     this->expression();
     this->consume(Token::Type::LEFT_BRACE, "expect '{' after condition");
 
+    auto folded = this->fold_condition(loop_start);
+    if (folded.has_value()) {
+      if (*folded) {
+        // while true is just a loop
+        this->wrap_loop(loop_start, [&] {
+          this->block_stmt();
+          if (this->reachable) {
+            this->emit_instruction(Instruction{OpCode::LOOP, this->program.instruction_count() - loop_start});
+          }
+          for (const auto jmp : this->breaks) { this->patch_jump(jmp); }
+
+          this->reachable = !this->breaks.empty();
+        });
+      } else {
+        this->discard([&] { this->wrap_loop(loop_start, [&] { this->block_stmt(); }); });
+      }
+      return;
+    }
+
     std::size_t exit_jmp = this->emit_jump(Instruction{OpCode::JUMP_IF_FALSE});
 
     this->emit_instruction(Instruction{OpCode::POP});
     this->wrap_loop(loop_start, [&] {
       this->block_stmt();
 
-      this->emit_instruction(Instruction{OpCode::LOOP, this->chunk.instruction_count() - loop_start});
+      if (this->reachable) {
+        this->emit_instruction(Instruction{OpCode::LOOP, this->program.instruction_count() - loop_start});
+      }
 
       this->patch_jump(exit_jmp);
       this->emit_instruction(Instruction{OpCode::POP});
       for (const auto jmp : this->breaks) { this->patch_jump(jmp); }
+
+      this->reachable = true;
     });
   }
 
   void Parser::for_stmt()
   {
+    auto counted = this->match_counted_loop();
+    if (counted.has_value()) {
+      this->wrap_block([&] { this->counted_for_stmt(*counted); });
+      return;
+    }
+
     this->wrap_block([&] {
       if (this->advance_if_matches(Token::Type::SEMICOLON)) {
         // no initializer
@@ -1281,7 +1997,7 @@ namespace ss
         this->expression_stmt();
       }
 
-      std::size_t loop_start = this->chunk.instruction_count();
+      std::size_t loop_start = this->program.instruction_count();
 
       bool has_exit = false;
       std::size_t exit_jmp;
@@ -1299,12 +2015,11 @@ namespace ss
       if (!this->advance_if_matches(Token::Type::LEFT_BRACE)) {
         std::size_t body_jmp = this->emit_jump(Instruction{OpCode::JUMP});
 
-        std::size_t increment_start = this->chunk.instruction_count();
-        this->expression();
-        this->emit_instruction(Instruction{OpCode::POP});
+        std::size_t increment_start = this->program.instruction_count();
+        this->effect_expression();
         this->consume(Token::Type::LEFT_BRACE, "expect '}' after clauses");
 
-        this->emit_instruction(Instruction{OpCode::LOOP, this->chunk.instruction_count() - loop_start});
+        this->emit_instruction(Instruction{OpCode::LOOP, this->program.instruction_count() - loop_start});
         loop_start = increment_start;
         this->patch_jump(body_jmp);
       }
@@ -1312,47 +2027,397 @@ namespace ss
       this->wrap_loop(loop_start, [&] {
         this->block_stmt();
 
-        this->emit_instruction(Instruction{OpCode::LOOP, this->chunk.instruction_count() - loop_start});
+        if (this->reachable) {
+          this->emit_instruction(Instruction{OpCode::LOOP, this->program.instruction_count() - loop_start});
+        }
 
         if (has_exit) {
           this->patch_jump(exit_jmp);
           this->emit_instruction(Instruction{OpCode::POP});
-          for (const auto jmp : this->breaks) { this->patch_jump(jmp); }
         }
+        for (const auto jmp : this->breaks) { this->patch_jump(jmp); }
+
+        this->reachable = has_exit || !this->breaks.empty();
       });
     });
   }
 
+  auto Parser::match_counted_loop() const -> std::optional<CountedLoop>
+  {
+    auto at = [this](TokenIterator tok, Token::Type type) { return tok < this->tokens.end() && tok->type == type; };
+    auto is_name = [&at](TokenIterator tok, TokenIterator name) {
+      return at(tok, Token::Type::IDENTIFIER) && tok->lexeme == name->lexeme;
+    };
+
+    // let i = <initializer>;
+    auto name = this->iter + 1;
+    if (!at(this->iter, Token::Type::LET) || !at(name, Token::Type::IDENTIFIER) || !at(name + 1, Token::Type::EQUAL)) {
+      return std::nullopt;
+    }
+
+    auto tok = name + 2;
+    while (tok < this->tokens.end() && tok->type != Token::Type::SEMICOLON && tok->type != Token::Type::END_OF_FILE) { tok++; }
+    if (!at(tok, Token::Type::SEMICOLON)) {
+      return std::nullopt;
+    }
+
+    // i <comparison> <limit>;
+    tok++;
+    if (!is_name(tok, name) || tok + 1 >= this->tokens.end()) {
+      return std::nullopt;
+    }
+
+    CountedLoop loop;
+    switch ((tok + 1)->type) {
+      case Token::Type::LESS: {
+        loop.comparison = ForComparison::LESS;
+      } break;
+      case Token::Type::LESS_EQUAL: {
+        loop.comparison = ForComparison::LESS_EQUAL;
+      } break;
+      case Token::Type::GREATER: {
+        loop.comparison = ForComparison::GREATER;
+      } break;
+      case Token::Type::GREATER_EQUAL: {
+        loop.comparison = ForComparison::GREATER_EQUAL;
+      } break;
+      default:
+        return std::nullopt;
+    }
+
+    auto limit = tok + 2;
+    if (
+     !(at(limit, Token::Type::NUMBER) || (at(limit, Token::Type::IDENTIFIER) && !is_name(limit, name))) ||
+     !at(limit + 1, Token::Type::SEMICOLON)) {
+      return std::nullopt;
+    }
+
+    // i = i +/- <positive number> {
+    tok = limit + 2;
+    bool ascending = loop.comparison == ForComparison::LESS || loop.comparison == ForComparison::LESS_EQUAL;
+    if (
+     !is_name(tok, name) || !at(tok + 1, Token::Type::EQUAL) || !is_name(tok + 2, name) ||
+     !at(tok + 3, ascending ? Token::Type::PLUS : Token::Type::MINUS) || !at(tok + 4, Token::Type::NUMBER) ||
+     !at(tok + 5, Token::Type::LEFT_BRACE)) {
+      return std::nullopt;
+    }
+
+    // a step of 0 or one that counts away from the limit would loop forever, leave those as they are written
+    Value::NumberType step;
+    if (!util::parse_number((tok + 4)->lexeme, step) || step <= 0) {
+      return std::nullopt;
+    }
+
+    if (limit->type == Token::Type::NUMBER) {
+      return loop;
+    }
+
+    // the limit is only evaluated once, so it must not be assignable from within the body. Locals can only be assigned by
+    // name, globals may also be assigned by any function called
+    bool global = this->resolve_local(limit).type == VarLookup::Type::GLOBAL;
+    std::size_t depth = 0;
+    for (tok = tok + 5; tok < this->tokens.end() && tok->type != Token::Type::END_OF_FILE; tok++) {
+      if (tok->type == Token::Type::LEFT_BRACE) {
+        depth++;
+      } else if (tok->type == Token::Type::RIGHT_BRACE && --depth == 0) {
+        return loop;
+      } else if (is_name(tok, limit) && at(tok + 1, Token::Type::EQUAL)) {
+        return std::nullopt;
+      } else if (global && tok->type == Token::Type::LEFT_PAREN) {
+        return std::nullopt;
+      }
+    }
+
+    return std::nullopt;
+  }
+
+  void Parser::counted_for_stmt(CountedLoop loop)
+  {
+    this->advance();
+    this->let_stmt();
+
+    // skip the counter and comparison, the comparison is encoded in the loop instructions
+    this->advance();
+    this->advance();
+    this->expression();
+    this->consume(Token::Type::SEMICOLON, "expect ';'");
+    this->add_hidden_local();
+
+    // skip the counter, equal, counter, and operator, the direction is implied by the comparison
+    for (int i = 0; i < 4; i++) { this->advance(); }
+    this->advance();
+    this->make_number(false);
+    this->add_hidden_local();
+
+    this->consume(Token::Type::LEFT_BRACE, "expect '{' after clauses");
+
+    std::size_t prep_jmp   = this->emit_jump(Instruction{OpCode::FOR_PREP});
+    std::size_t body_start = this->program.instruction_count();
+
+    this->wrap_loop(std::nullopt, [&] {
+      this->block_stmt();
+
+      for (const auto jmp : this->continues) { this->patch_jump(jmp); }
+
+      this->emit_instruction(
+       Instruction{OpCode::FOR_LOOP, for_loop_bits(this->program.instruction_count() - body_start, loop.comparison)});
+
+      this->program.index_code_mut(prep_jmp)->modifying_bits =
+       for_loop_bits(this->program.instruction_count() - prep_jmp, loop.comparison);
+
+      for (const auto jmp : this->breaks) { this->patch_jump(jmp); }
+
+      this->reachable = true;
+    });
+  }
+
   void Parser::match_stmt()
   {
     this->expression();
+
+    if (this->is_literal_match()) {
+      this->literal_match_stmt();
+      return;
+    }
+
     this->consume(Token::Type::LEFT_BRACE, "expect '{' after condition");
+    this->add_hidden_local();
+
+    std::pmr::vector<std::size_t> exits(this->arena);
 
     while (!this->check(Token::Type::END_OF_FILE) && !this->check(Token::Type::RIGHT_BRACE)) {
       this->expression();
       this->consume(Token::Type::ARROW, "expect '=>' after expression");
       this->emit_instruction(Instruction{OpCode::CHECK});
       std::size_t next_jmp = this->emit_jump(Instruction{OpCode::JUMP_IF_FALSE});
+      this->emit_instruction(Instruction{OpCode::POP});
       this->statement();
+      if (this->reachable) {
+        exits.push_back(this->emit_jump(Instruction{OpCode::JUMP}));
+      }
+      // a ret, break, or cont in one arm does not make the next arm unreachable
+      this->reachable = true;
       this->patch_jump(next_jmp);
       this->emit_instruction(Instruction{OpCode::POP});
     }
+
+    for (const auto jmp : exits) { this->patch_jump(jmp); }
+
+    this->locals.pop_back();
+    this->emit_instruction(Instruction{OpCode::POP});
+
+    this->consume(Token::Type::RIGHT_BRACE, "expected '}' after match");
+  }
+
+  auto Parser::is_in_place_add(TokenIterator name, bool global) const -> bool
+  {
+    if (
+     this->iter->type != Token::Type::IDENTIFIER || this->iter->lexeme != name->lexeme ||
+     (this->iter + 1)->type != Token::Type::PLUS) {
+      return false;
+    }
+
+    auto operand     = this->iter + 2;
+    std::size_t depth = 0;
+    for (auto tok = operand; tok < this->tokens.end(); tok++) {
+      switch (tok->type) {
+        case Token::Type::LEFT_PAREN: {
+          // a function could assign a global, but never a local of its caller. A paren ending a callee, named or
+          // parenthesized, starts a call rather than a grouping
+          if (global && tok != operand) {
+            switch ((tok - 1)->type) {
+              case Token::Type::IDENTIFIER:
+              case Token::Type::RIGHT_PAREN:
+              case Token::Type::STRING:
+              case Token::Type::NUMBER: {
+                return false;
+              }
+              default:
+                break;
+            }
+          }
+          depth++;
+        } break;
+        case Token::Type::RIGHT_PAREN: {
+          if (depth == 0) {
+            return tok != operand;
+          }
+          depth--;
+        } break;
+        case Token::Type::SEMICOLON:
+        case Token::Type::LEFT_BRACE:
+        case Token::Type::COMMA:
+        case Token::Type::END_OF_FILE: {
+          return depth == 0 && tok != operand;
+        }
+        case Token::Type::RIGHT_BRACE:
+        case Token::Type::ARROW: {
+          return false;
+        }
+        // anything binding looser than a factor would make the sum an operand of something else, unary minus included to
+        // keep this simple
+        case Token::Type::PLUS:
+        case Token::Type::MINUS:
+        case Token::Type::EQUAL_EQUAL:
+        case Token::Type::BANG_EQUAL:
+        case Token::Type::GREATER:
+        case Token::Type::GREATER_EQUAL:
+        case Token::Type::LESS:
+        case Token::Type::LESS_EQUAL:
+        case Token::Type::AND:
+        case Token::Type::OR:
+        case Token::Type::EQUAL: {
+          if (depth == 0) {
+            return false;
+          }
+          // the variable would change before it is added onto
+          if (tok->type == Token::Type::EQUAL && (tok - 1)->lexeme == name->lexeme) {
+            return false;
+          }
+        } break;
+        default:
+          break;
+      }
+    }
+
+    return false;
+  }
+
+  auto Parser::is_literal_match() const -> bool
+  {
+    std::size_t arms  = 0;
+    std::size_t depth = 0;
+
+    // arrows directly inside the braces of this match belong to its arms, any others are in nested matches
+    for (auto tok = this->iter; tok < this->tokens.end() && tok->type != Token::Type::END_OF_FILE; tok++) {
+      switch (tok->type) {
+        case Token::Type::LEFT_BRACE: {
+          depth++;
+        } break;
+        case Token::Type::RIGHT_BRACE: {
+          if (depth <= 1) {
+            return depth == 1 && arms > 0;
+          }
+          depth--;
+        } break;
+        case Token::Type::ARROW: {
+          if (depth != 1) {
+            break;
+          }
+
+          // the pattern must be the literal alone, so the token before it has to end the previous arm
+          auto literal = tok - 1;
+          auto before  = tok - 2;
+          if (
+           before->type != Token::Type::LEFT_BRACE && before->type != Token::Type::RIGHT_BRACE &&
+           before->type != Token::Type::SEMICOLON) {
+            return false;
+          }
+
+          if (literal->type != Token::Type::NUMBER && literal->type != Token::Type::STRING) {
+            return false;
+          }
+          arms++;
+        } break;
+        default:
+          break;
+      }
+    }
+
+    return false;
+  }
+
+  void Parser::literal_match_stmt()
+  {
+    this->consume(Token::Type::LEFT_BRACE, "expect '{' after condition");
+    this->add_hidden_local();
+
+    std::size_t table_loc = this->emit_jump(Instruction{OpCode::MATCH_TABLE});
+
+    std::pmr::vector<std::pair<Value::NumberType, std::size_t>> numbers(this->arena);
+    std::pmr::vector<std::size_t> exits(this->arena);
+    JumpTable table;
+
+    while (!this->check(Token::Type::END_OF_FILE) && !this->check(Token::Type::RIGHT_BRACE)) {
+      this->advance();
+      auto literal = this->previous();
+      this->consume(Token::Type::ARROW, "expect '=>' after expression");
+
+      std::size_t offset = this->program.instruction_count() - table_loc;
+      if (literal->type == Token::Type::NUMBER) {
+        Value::NumberType number;
+        if (!util::parse_number(literal->lexeme, number)) {
+          this->error(literal, "unparsable number");
+        }
+        numbers.emplace_back(number, offset);
+      } else {
+        table.strings.emplace(literal->lexeme, offset);
+      }
+
+      this->statement();
+
+      // the last arm falls out of the match on its own
+      if (this->reachable && !this->check(Token::Type::RIGHT_BRACE)) {
+        exits.push_back(this->emit_jump(Instruction{OpCode::JUMP}));
+      }
+      this->reachable = true;
+    }
+
+    if (!numbers.empty()) {
+      auto [min, max] = std::minmax_element(numbers.begin(), numbers.end());
+      auto span       = max->first - min->first + 1;
+      bool integral   = std::all_of(numbers.begin(), numbers.end(), [](const auto& arm) {
+        return std::floor(arm.first) == arm.first;
+      });
+
+      if (integral && span <= static_cast<Value::NumberType>(numbers.size() * 2 + 8)) {
+        table.dense_base = min->first;
+        table.dense.resize(static_cast<std::size_t>(span));
+        for (const auto& [n, offset] : numbers) {
+          // the first of duplicate arms wins, as it would when comparing in order
+          auto& slot = table.dense[static_cast<std::size_t>(n - table.dense_base)];
+          if (slot == 0) {
+            slot = offset;
+          }
+        }
+      } else {
+        for (const auto& [n, offset] : numbers) { table.numbers.emplace(n, offset); }
+      }
+    }
+
+    for (const auto jmp : exits) { this->patch_jump(jmp); }
+
+    table.default_offset = this->program.instruction_count() - table_loc;
+
+    this->program.index_code_mut(table_loc)->modifying_bits = this->program.add_jump_table(std::move(table));
+
+    this->locals.pop_back();
     this->emit_instruction(Instruction{OpCode::POP});
 
     this->consume(Token::Type::RIGHT_BRACE, "expected '}' after match");
   }
 
+  void Parser::add_hidden_local() noexcept
+  {
+    // value initialized, the empty name can never be resolved by an identifier
+    Local local{};
+    local.depth       = this->scope_depth;
+    local.initialized = true;
+    this->locals.push_back(local);
+  }
+
   void Parser::break_stmt()
   {
     if (!this->in_loop) {
       this->error(this->previous(), "breaks can only be used within loops");
     }
     this->consume(Token::Type::SEMICOLON, "expect ';' after break");
-    std::size_t count = this->reduce_locals_to_depth(this->loop_depth);
+    std::size_t count = this->locals_above_depth(this->loop_depth);
     if (count > 0) {
       this->emit_instruction(Instruction{OpCode::POP_N, count});
     }
     this->breaks.push_back(this->emit_jump(Instruction{OpCode::JUMP}));
+    this->reachable = false;
   }
 
   void Parser::continue_stmt()
@@ -1361,11 +2426,16 @@ namespace ss
       this->error(this->previous(), "continues can only be used within loops");
     }
     this->consume(Token::Type::SEMICOLON, "expect ';' after continue");
-    std::size_t count = this->reduce_locals_to_depth(this->loop_depth);
+    std::size_t count = this->locals_above_depth(this->loop_depth);
     if (count > 0) {
       this->emit_instruction(Instruction{OpCode::POP_N, count});
     }
-    this->emit_instruction(Instruction{OpCode::LOOP, this->chunk.instruction_count() - this->continue_jmp});
+    if (this->continue_jmp.has_value()) {
+      this->emit_instruction(Instruction{OpCode::LOOP, this->program.instruction_count() - *this->continue_jmp});
+    } else {
+      this->continues.push_back(this->emit_jump(Instruction{OpCode::JUMP}));
+    }
+    this->reachable = false;
   }
 
   void Parser::return_stmt()
@@ -1383,7 +2453,7 @@ namespace ss
     // - 3 for func, stack ptr, & ret addr
     this->emit_instruction(Instruction{OpCode::MOVE, this->locals.size() - this->locals_in_function - 3});
 
-    std::size_t count = this->reduce_locals_to_depth(this->function_depth);
+    std::size_t count = this->locals_above_depth(this->function_depth);
     if (count > 0) {
       this->emit_instruction(Instruction{OpCode::POP_N, count});
     }
@@ -1392,6 +2462,7 @@ namespace ss
       this->emit_instruction(Instruction{OpCode::NIL});
     }
     this->emit_instruction(Instruction{OpCode::RETURN, this->locals_in_function});
+    this->reachable = false;
   }
 
   void Parser::end_stmt()
@@ -1403,6 +2474,7 @@ namespace ss
     }
     this->consume(Token::Type::SEMICOLON, "expected ';' after end");
     this->emit_instruction(Instruction{OpCode::END});
+    this->reachable = false;
   }
 
   void Parser::load_stmt()
@@ -1413,32 +2485,14 @@ namespace ss
     this->consume(Token::Type::STRING, "expected file to be string type");
     auto file = this->previous()->lexeme;
     this->consume(Token::Type::SEMICOLON, "expected ';' after load stmt");
-    auto libdirs    = std::getenv("SS_LIB");
     bool file_found = false;
 
-    std::string dirs;
-    if (libdirs == nullptr) {
-      auto home = std::getenv("HOME");
-      if (home != nullptr) {
-        std::stringstream ss;
-        ss << home << '/' << ".simple";
-        dirs = ss.str();
-      }
-    } else {
-      dirs = libdirs;
-    }
-
-    std::istringstream iss(dirs);
-    std::string line;
-    while (std::getline(iss, line, ':')) {
+    for (const auto& dir : this->library_paths) {
       std::stringstream ss;
-      ss << line << '/' << file;
+      ss << dir << '/' << file;
       std::string path = ss.str();
       if (std::filesystem::exists(path)) {
-        auto contents = util::load_file_to_string(path);
-
-        Compiler compiler;
-        compiler.compile(std::move(contents), this->chunk, path);
+        this->load_file(path);
         file_found = true;
       }
     }
@@ -1465,10 +2519,7 @@ namespace ss
       this->error(this->previous(), "unable to load file");
     }
 
-    auto contents = util::load_file_to_string(path.string());
-
-    Compiler compiler;
-    compiler.compile(std::move(contents), this->chunk, path.string());
+    this->load_file(path.string());
   }
 
   void Parser::fn_stmt()
@@ -1481,14 +2532,52 @@ namespace ss
     this->define_variable(global);
   }
 
-  void Compiler::compile(std::string&& src, BytecodeChunk& chunk, std::string current_file)
+  Compiler::Compiler()
+   : library_paths(default_library_paths())
+  {}
+
+  Compiler::Compiler(LibraryPaths lp)
+   : library_paths(std::move(lp))
+  {}
+
+  void Compiler::compile(std::string&& src, Program& program, std::string current_file) const
   {
-    Scanner scanner(std::move(src));
+    // everything the scanner & parser allocate dies with the compile, so it is bump allocated and released at once
+    std::pmr::monotonic_buffer_resource arena(std::max(src.size() * ARENA_BYTES_PER_SOURCE_BYTE, MIN_ARENA_SIZE));
+
+    Scanner scanner(std::move(src), &arena);
 
     auto tokens = scanner.scan();
 
-    Parser parser(std::move(tokens), chunk, current_file);
+    Parser parser(std::move(tokens), program, current_file, this->library_paths);
 
     parser.parse();
   }
+
+  auto Compiler::default_library_paths() -> const LibraryPaths&
+  {
+    // initialized exactly once even when the first compiles race, getenv is never called again after
+    static const LibraryPaths paths = [] {
+      std::string dirs;
+      auto libdirs = std::getenv("SS_LIB");
+      if (libdirs == nullptr) {
+        auto home = std::getenv("HOME");
+        if (home != nullptr) {
+          std::stringstream ss;
+          ss << home << '/' << ".simple";
+          dirs = ss.str();
+        }
+      } else {
+        dirs = libdirs;
+      }
+
+      LibraryPaths paths;
+      std::istringstream iss(dirs);
+      std::string dir;
+      while (std::getline(iss, dir, ':')) { paths.push_back(std::move(dir)); }
+      return paths;
+    }();
+
+    return paths;
+  }
 }  // namespace ss
\ No newline at end of file
@@ -3,10 +3,16 @@
 #include "cfg.hpp"
 #include "datatypes.hpp"
 #include "exceptions.hpp"
+#include "gc.hpp"
 
+#include <array>
 #include <cinttypes>
-#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -73,6 +79,16 @@ namespace ss
      * @brief Assigns a value to the global variable. The value comes off the top of the stack
      */
     ASSIGN_GLOBAL,
+    /**
+     * @brief Pops a value off the stack and adds it onto the local variable in place. The modifying bits are packed by
+     * add_assign_bits()
+     */
+    ADD_ASSIGN_LOCAL,
+    /**
+     * @brief Pops a value off the stack and adds it onto the global variable in place. The modifying bits are packed by
+     * add_assign_bits(), the index being that of the name in the constant list
+     */
+    ADD_ASSIGN_GLOBAL,
     /**
      * @brief Pops two values off the stack, compares, then pushes the result back on
      */
@@ -153,6 +169,21 @@ namespace ss
      * @brief Jumps the instruction pointer backwards N instructions. N specified by the modifying bits
      */
     LOOP,
+    /**
+     * @brief Enters a counted for loop. The top three values of the stack are the counter, limit, and step. If the counter
+     * fails the comparison with the limit, jumps forward past the loop. The modifying bits are packed by for_loop_bits()
+     */
+    FOR_PREP,
+    /**
+     * @brief Steps the counter of a counted for loop, then jumps backwards to the start of the body if the counter still
+     * passes the comparison with the limit. The stack layout and modifying bits are the same as FOR_PREP
+     */
+    FOR_LOOP,
+    /**
+     * @brief Peeks at the stack and jumps forward to the arm the value selects in the jump table indexed by the modifying
+     * bits, or to the table's default when no arm does
+     */
+    MATCH_TABLE,
     /**
      * @brief Peeks at the stack, if the top value is true short circuts to the instruction pointed to by the modifying bit
      */
@@ -178,8 +209,83 @@ namespace ss
     OpCode major_opcode = OpCode::NO_OP;
     // TODO set this up to be a union { struct { uint8_t, uint16_t, & uint32_t }; /* other combinations */ };
     std::size_t modifying_bits = 0;
+
+    auto operator==(const Instruction& other) const noexcept -> bool;
+  };
+
+  /**
+   * @brief The comparison a counted for loop continues on. Ascending loops add the step, descending loops subtract it
+   */
+  enum class ForComparison : std::uint8_t
+  {
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
   };
 
+  /**
+   * @brief Packs the modifying bits of a FOR_PREP or FOR_LOOP. The low two bits are the comparison, the rest the jump offset
+   */
+  constexpr auto for_loop_bits(std::size_t offset, ForComparison comparison) noexcept -> std::size_t
+  {
+    return (offset << 2) | static_cast<std::size_t>(comparison);
+  }
+
+  constexpr auto for_loop_offset(std::size_t bits) noexcept -> std::size_t
+  {
+    return bits >> 2;
+  }
+
+  constexpr auto for_loop_comparison(std::size_t bits) noexcept -> ForComparison
+  {
+    return static_cast<ForComparison>(bits & 0b11);
+  }
+
+  /**
+   * @brief Whether a counted for loop goes around again with the counter at where it now is
+   */
+  template <typename T>
+  constexpr auto for_loop_continues(ForComparison comparison, const T& counter, const T& limit) -> bool
+  {
+    switch (comparison) {
+      case ForComparison::LESS: {
+        return counter < limit;
+      }
+      case ForComparison::LESS_EQUAL: {
+        return counter <= limit;
+      }
+      case ForComparison::GREATER: {
+        return counter > limit;
+      }
+      case ForComparison::GREATER_EQUAL: {
+        return counter >= limit;
+      }
+      default:
+        break;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Packs the modifying bits of an ADD_ASSIGN_LOCAL or ADD_ASSIGN_GLOBAL. The low bit is whether the new value of the
+   * variable is pushed, the rest the variable's index
+   */
+  constexpr auto add_assign_bits(std::size_t index, bool push_result) noexcept -> std::size_t
+  {
+    return (index << 1) | static_cast<std::size_t>(push_result);
+  }
+
+  constexpr auto add_assign_index(std::size_t bits) noexcept -> std::size_t
+  {
+    return bits >> 1;
+  }
+
+  constexpr auto add_assign_pushes(std::size_t bits) noexcept -> bool
+  {
+    return (bits & 0b1) != 0;
+  }
+
   constexpr auto to_string(OpCode op) noexcept -> const char*
   {
     switch (op) {
@@ -195,6 +301,8 @@ namespace ss
       SS_ENUM_TO_STR_CASE(OpCode, LOOKUP_GLOBAL)
       SS_ENUM_TO_STR_CASE(OpCode, DEFINE_GLOBAL)
       SS_ENUM_TO_STR_CASE(OpCode, ASSIGN_GLOBAL)
+      SS_ENUM_TO_STR_CASE(OpCode, ADD_ASSIGN_LOCAL)
+      SS_ENUM_TO_STR_CASE(OpCode, ADD_ASSIGN_GLOBAL)
       SS_ENUM_TO_STR_CASE(OpCode, EQUAL)
       SS_ENUM_TO_STR_CASE(OpCode, NOT_EQUAL)
       SS_ENUM_TO_STR_CASE(OpCode, GREATER)
@@ -215,6 +323,9 @@ namespace ss
       SS_ENUM_TO_STR_CASE(OpCode, JUMP)
       SS_ENUM_TO_STR_CASE(OpCode, JUMP_IF_FALSE)
       SS_ENUM_TO_STR_CASE(OpCode, LOOP)
+      SS_ENUM_TO_STR_CASE(OpCode, FOR_PREP)
+      SS_ENUM_TO_STR_CASE(OpCode, FOR_LOOP)
+      SS_ENUM_TO_STR_CASE(OpCode, MATCH_TABLE)
       SS_ENUM_TO_STR_CASE(OpCode, OR)
       SS_ENUM_TO_STR_CASE(OpCode, AND)
       SS_ENUM_TO_STR_CASE(OpCode, PUSH_SP)
@@ -363,27 +474,110 @@ namespace ss
   auto operator<<(std::ostream& ostream, const Token::Type& type) -> std::ostream&;
   auto operator<<(std::ostream& ostream, const Token& token) -> std::ostream&;
 
-  class BytecodeChunk
+  /**
+   * @brief Where in the source an instruction was generated from
+   */
+  struct SourceLocation
+  {
+    std::size_t line   = 0;
+    std::size_t column = 0;
+    /**
+     * @brief Id of the file as registered with the program
+     */
+    std::size_t file = 0;
+
+    auto operator==(const SourceLocation& other) const noexcept -> bool;
+  };
+
+  /**
+   * @brief Dispatch table of a match whose arms are all number or string literals. Offsets are relative to the
+   * MATCH_TABLE instruction using the table
+   */
+  struct JumpTable
+  {
+    /**
+     * @brief Arms of integral numbers spanning a small range, indexed from the base. An offset of 0 is a hole
+     */
+    Value::NumberType dense_base = 0;
+    std::vector<std::size_t> dense;
+
+    /**
+     * @brief Arms of numbers too sparse for the dense table
+     */
+    std::unordered_map<Value::NumberType, std::size_t> numbers;
+
+    std::unordered_map<Value::StringType, std::size_t> strings;
+
+    std::size_t default_offset = 0;
+
+    /**
+     * @brief Finds the arm matching the value. The value is never converted, so it selects the same arm as comparing it
+     * against every literal in turn would
+     *
+     * @return The offset of the arm, or the default offset if none matches
+     */
+    auto offset_for(const Value& value) const noexcept -> std::size_t;
+  };
+
+  /**
+   * @brief Compiled code along with its constants and debug info. Only written while compiling, after which vms share it
+   * as a const program, so any number of them may run it from separate threads at once
+   */
+  class Program
   {
+    /**
+     * @brief A run of consecutive instructions generated from the same location, starting at the offset
+     */
+    struct LocationRun
+    {
+      std::uint32_t offset;
+      std::uint32_t line;
+      std::uint32_t column;
+      std::uint32_t file;
+    };
+
    public:
     using Instructions        = std::vector<Instruction>;
-    using InstructionIterator = Instructions::iterator;
+    using InstructionIterator = Instructions::const_iterator;
+
+    /**
+     * @brief Hashes owned identifiers and views of source text alike so lookups never allocate
+     */
+    struct IdentifierHash
+    {
+      using is_transparent = void;
+
+      auto operator()(std::string_view name) const noexcept -> std::size_t;
+    };
 
-    using GlobalMap            = std::unordered_map<Value::StringType, Value>;
     using LocalCache           = std::unordered_map<std::size_t, std::string>;
-    using IdentifierCache      = std::unordered_map<std::string_view, std::size_t>;
+    using IdentifierCache      = std::unordered_map<std::string, std::size_t, IdentifierHash, std::equal_to<>>;
     using IdentifierCacheEntry = IdentifierCache::const_iterator;
+    using Functions            = std::vector<std::shared_ptr<Function>>;
 
     /**
-     * @brief Prepares the chunk for a new script, however globals remain intact
+     * @brief Creates a function owned by the program instead of a heap, so it is never collected and vms may share it.
+     * Copies of the program share its functions
      */
-    void prepare() noexcept;
+    auto make_function(std::string name, std::size_t airity, std::size_t ip, std::size_t max_stack) -> Function*;
+
+    auto functions() const noexcept -> const Functions&;
+
+    /**
+     * @brief Writes the instruction and tags it with the location
+     */
+    void write(Instruction, SourceLocation location) noexcept;
 
     /**
      * @brief Writes the instruction and tags it with the line
      */
     void write(Instruction, std::size_t line) noexcept;
 
+    /**
+     * @brief Writes a constant instruction and tags the instruction with the location
+     */
+    void write_constant(Value v, SourceLocation location) noexcept;
+
     /**
      * @brief Writes a constant instruction and tags the instruction with the line
      */
@@ -403,6 +597,196 @@ namespace ss
      */
     auto constant_at(std::size_t offset) const noexcept -> Value;
 
+    /**
+     * @brief Get the number of constants in the constant buffer
+     *
+     * @return The number of constants
+     */
+    auto constant_count() const noexcept -> std::size_t;
+
+    /**
+     * @brief The constants laid out contiguously, for the interpreter to index directly
+     */
+    auto constant_data() const noexcept -> const Value*;
+
+    /**
+     * @brief Grabs the line at the given offset
+     *
+     * @return The line number
+     */
+    auto line_at(std::size_t offset) const noexcept -> std::size_t;
+
+    /**
+     * @brief Grabs the full source location at the given offset. Runs are binary searched so this is O(log n)
+     *
+     * @return The location, or a default location if the offset precedes every instruction
+     */
+    auto location_at(std::size_t offset) const noexcept -> SourceLocation;
+
+    /**
+     * @brief Registers a source file with the program. Registering the same file twice yields the same id
+     *
+     * @return The id to tag locations in that file with
+     */
+    auto add_file(std::string path) noexcept -> std::size_t;
+
+    /**
+     * @brief Looks up the path of a registered file
+     *
+     * @return The path of the file, or an empty string if the id was never registered
+     */
+    auto file_name(std::size_t id) const noexcept -> std::string;
+
+    auto instruction_count() const noexcept -> std::size_t;
+
+    auto instruction_at(std::size_t index) const noexcept -> InstructionIterator;
+
+    auto index_code_mut(std::size_t index) -> Instructions::iterator;
+
+    /**
+     * @brief Removes every instruction at or after the given count, along with their locations. Constants are left intact
+     */
+    void truncate(std::size_t instruction_count) noexcept;
+
+    /**
+     * @brief How much of each table is in use, for rolling back code compiled after it
+     */
+    struct Checkpoint
+    {
+      std::size_t code;
+      std::size_t constants;
+      std::size_t jump_tables;
+      std::size_t locations;
+      std::size_t files;
+      std::size_t functions;
+    };
+
+    auto checkpoint() const noexcept -> Checkpoint;
+
+    /**
+     * @brief Removes everything added since the checkpoint was taken, such as by a compile that failed
+     */
+    void rollback(const Checkpoint& checkpoint) noexcept;
+
+    /**
+     * @brief Adds a jump table for a MATCH_TABLE instruction
+     *
+     * @return The index to use as the modifying bits of the instruction
+     */
+    auto add_jump_table(JumpTable table) noexcept -> std::size_t;
+
+    auto jump_table_at(std::size_t index) const noexcept -> const JumpTable&;
+
+    /**
+     * @brief Follows every path from the entry until it returns or ends, so the stack can be made room for once instead of on
+     * every push. Calls count only what they leave behind, the callee makes room for its own frame
+     *
+     * @return The most values the code pushes above where the stack was at the entry
+     */
+    auto max_stack_depth(std::size_t entry) const -> std::size_t;
+
+    /**
+     * @brief Checks the code from the entry & every function defined after it once, so the vm need not check it on every
+     * run. Operand indices must exist, jumps must stay within the code, every path into an instruction must reach it at the
+     * same depth without popping what it did not push, global names must be strings, and calls & returns must leave
+     * addresses where the other expects them
+     *
+     * @throws CompiletimeError if anything does not hold
+     */
+    void verify(std::size_t entry) const;
+
+    auto find_ident(std::string_view name) const noexcept -> IdentifierCacheEntry;
+    auto is_entry_found(IdentifierCacheEntry entry) const noexcept -> bool;
+
+    /**
+     * @brief Adds the identifier to the cache
+     *
+     * @return The index in the list of constants
+     */
+    auto add_ident(std::string_view name) noexcept -> std::size_t;
+
+    auto begin() const noexcept -> InstructionIterator;
+
+    auto end() const noexcept -> InstructionIterator;
+
+    void print_constants(VMConfig& cfg) const noexcept;
+
+   private:
+    Instructions code;
+    std::vector<Value> constants;
+    std::vector<JumpTable> jump_tables;
+    std::vector<LocationRun> locations;
+    std::vector<std::string> files;
+    IdentifierCache identifier_cache;
+    Functions function_list;
+
+    void add_location(SourceLocation location) noexcept;
+
+    /**
+     * @brief Follows every path from the entry, a function's body when given its airity
+     *
+     * @return The most values pushed above where the stack was at the entry
+     */
+    auto walk_stack(std::size_t entry, bool verify, std::optional<std::size_t> airity) const -> std::size_t;
+  };
+
+  /**
+   * @brief Everything a vm mutates while running a program: the stack its call frames are built on, the globals, and the heap
+   * they reference. Each thread running a program needs its own
+   */
+  class ExecutionContext
+  {
+   public:
+    using GlobalMap = std::unordered_map<Value::StringType, Value>;
+
+    ExecutionContext(HeapConfig heap_config = HeapConfig());
+    ExecutionContext(const ExecutionContext&) = delete;
+    ~ExecutionContext();
+
+    auto operator=(const ExecutionContext&) -> ExecutionContext& = delete;
+
+    /**
+     * @brief Prepares the context for a new program, however globals remain intact
+     */
+    void prepare() noexcept;
+
+    /**
+     * @brief Keeps the program's functions that the stack or globals still reference alive once the program is gone, letting
+     * go of any kept earlier that nothing references anymore
+     */
+    void retain_functions(const Program& program);
+
+    /**
+     * @brief Creates an object on the context's heap, collecting first if the heap has grown enough. The stack and globals
+     * are the roots, so the object must be stored in one of them before the next allocation
+     */
+    template <std::derived_from<Object> T, typename... Args>
+    auto make(Args&&... args) -> T*
+    {
+      if (this->heap.should_collect()) {
+        this->collect_garbage();
+      }
+      return this->heap.make<T>(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Frees every heap object unreachable from the stack and globals
+     */
+    void collect_garbage();
+
+    /**
+     * @brief Resource for the strings an instruction produces, promoting the nursery's survivors first if it filled up.
+     * Only the stack and globals are searched for survivors, so it must be requested before operands leave the stack
+     */
+    auto string_resource() -> std::pmr::memory_resource*;
+
+    /**
+     * @brief Moves the value's string out of the nursery, for values that leave the stack and globals for good
+     */
+    void promote(Value& value);
+
+    auto heap_stats() const noexcept -> const HeapStats&;
+
     /**
      * @brief Pushes a new value onto the stack
      */
@@ -456,25 +840,35 @@ namespace ss
     auto stack_size() const noexcept -> std::size_t;
 
     /**
-     * @brief Grabs the line at the given offset
-     *
-     * @return The line number
+     * @brief The first slot of the stack, for the interpreter to address values directly. Only the slots below the top hold
+     * values, the rest are uninitialized storage
      */
-    auto line_at(std::size_t offset) const noexcept -> std::size_t;
+    auto stack_base() noexcept -> Value*;
 
-    auto instruction_count() const noexcept -> std::size_t;
+    /**
+     * @brief One past the last value on the stack
+     */
+    auto stack_top() noexcept -> Value*;
 
-    auto index_code_mut(std::size_t index) -> InstructionIterator;
+    /**
+     * @brief One past the last slot, the stack must grow before anything is pushed there
+     */
+    auto stack_limit() noexcept -> Value*;
 
-    auto find_ident(std::string_view name) const noexcept -> IdentifierCacheEntry;
-    auto is_entry_found(IdentifierCacheEntry entry) const noexcept -> bool;
+    /**
+     * @brief Syncs the top with one the interpreter kept to itself. Every value above it must already be destroyed
+     */
+    void set_stack_top(Value* top) noexcept;
 
     /**
-     * @brief Adds the identifier to the cache
-     *
-     * @return The index in the list of constants
+     * @brief Makes room for more values, moving the stack so any pointer into it must be reacquired
      */
-    auto add_ident(std::string_view name) noexcept -> std::size_t;
+    void grow_stack();
+
+    /**
+     * @brief Grows the stack until the given number of values fit above the top
+     */
+    void reserve_stack(std::size_t room);
 
     void set_global(Value::StringType&& name, Value value) noexcept;
 
@@ -482,40 +876,44 @@ namespace ss
 
     auto is_global_found(GlobalMap::iterator it) const noexcept -> bool;
 
-    auto begin() noexcept -> InstructionIterator;
-
-    auto end() noexcept -> InstructionIterator;
-
     /**
      * @brief Prints the stack to the given output stream
      */
     void print_stack(VMConfig& cfg) const noexcept;
 
-    void print_constants(VMConfig& cfg) const noexcept;
-
    private:
-    Instructions code;
-    std::vector<Value> constants;
-    std::vector<Value> stack;
-    std::vector<std::size_t> lines;
-    std::size_t last_line            = 0;
-    std::size_t instructions_on_line = 0;
+    /**
+     * @brief Declared first so the objects it owns outlive every value referencing them
+     */
+    Heap heap;
+    /**
+     * @brief Values are constructed & destroyed in place as they are pushed & popped, like a vector that keeps its size to
+     * itself so the interpreter may keep it in a register instead
+     */
+    Value* stack;
+    std::size_t capacity;
+    std::size_t top;
     GlobalMap globals;
-    IdentifierCache identifier_cache;
-
-    void add_line(std::size_t line) noexcept;
+    /**
+     * @brief Functions of replaced programs that the stack or globals still referenced when they were replaced
+     */
+    Program::Functions retained;
   };
 
   class Scanner
   {
    public:
-    Scanner(std::string&& src) noexcept;
+    /**
+     * @brief Scans the source into tokens allocated from the resource, which should outlive the parse of them
+     */
+    Scanner(std::string&& src, std::pmr::memory_resource* resource = std::pmr::get_default_resource()) noexcept;
     ~Scanner() = default;
 
-    auto scan() -> std::vector<Token>;
+    auto scan() -> std::pmr::vector<Token>;
 
    private:
     std::string&& source;
+    std::pmr::memory_resource* resource;
     std::string::iterator starting_char;
     std::string::iterator current_char;
     std::size_t line;
@@ -543,6 +941,11 @@ namespace ss
     auto is_alpha(char c) const noexcept -> bool;
   };
 
+  /**
+   * @brief Directories searched, in order, by load statements
+   */
+  using LibraryPaths = std::vector<std::string>;
+
   struct Local
   {
     Token name;
@@ -552,7 +955,7 @@ namespace ss
 
   class Parser
   {
-    using TokenList     = std::vector<Token>;
+    using TokenList     = std::pmr::vector<Token>;
     using TokenIterator = TokenList::iterator;
 
     enum class Precedence
@@ -589,7 +992,7 @@ namespace ss
         }
       };
     }
-    using ParseFn = std::function<void(Parser*, bool)>;
+    using ParseFn = void (Parser::*)(bool);
 
     struct ParseRule
     {
@@ -598,6 +1001,8 @@ namespace ss
       Precedence precedence;
     };
 
+    using ParseRuleTable = std::array<ParseRule, static_cast<std::size_t>(Token::Type::LAST)>;
+
     struct VarLookup
     {
       enum class Type
@@ -615,18 +1020,42 @@ namespace ss
       FUNCTION,
     };
 
+    /**
+     * @brief A for loop in the canonical counted form, `for let i = a; i < b; i = i + c {`, whose limit cannot change
+     * while the loop runs
+     */
+    struct CountedLoop
+    {
+      ForComparison comparison;
+    };
+
    public:
-    Parser(TokenList&& tokens, BytecodeChunk& chunk, std::string current_file) noexcept;
+    Parser(
+     TokenList&& tokens, Program& program, std::string current_file, LibraryPaths library_paths = LibraryPaths()) noexcept;
     ~Parser() = default;
 
+    /**
+     * @brief Parses every declaration and terminates the program with an END instruction
+     */
     void parse();
 
    private:
+    /**
+     * @brief Immutable parse table shared by every parser, built at compile time
+     */
+    static const ParseRuleTable rules;
+
     TokenList tokens;
     TokenIterator iter;
-    BytecodeChunk& chunk;
+    Program& program;
     std::string current_file;
-    std::vector<Local> locals;
+    std::size_t file_id;
+    LibraryPaths library_paths;
+    /**
+     * @brief Where the parser's own bookkeeping is allocated, the same resource the tokens are in
+     */
+    std::pmr::memory_resource* arena;
+    std::pmr::vector<Local> locals;
 
     /**
      * @brief Current scope depth. 0 is the global namespace, depth > 0 creates local variables
@@ -639,9 +1068,14 @@ namespace ss
     bool in_loop;
 
     /**
-     * @brief Jump instruction to the beginning of the current loop
+     * @brief Jump instruction to the beginning of the current loop. Empty when the loop continues from its end instead
+     */
+    std::optional<std::size_t> continue_jmp;
+
+    /**
+     * @brief Jump instructions to patch to the end of a loop that continues from its end
      */
-    std::size_t continue_jmp;
+    std::pmr::vector<std::size_t> continues;
 
     /**
      * @brief Depth level at beginning of the loop
@@ -651,7 +1085,7 @@ namespace ss
     /**
      * @brief Jump instructions to patch after loop end
      */
-    std::vector<std::size_t> breaks;
+    std::pmr::vector<std::size_t> breaks;
 
     /**
      * @brief True if inside some kind of function, false otherwise
@@ -668,6 +1102,12 @@ namespace ss
      */
     std::size_t function_depth;
 
+    /**
+     * @brief False once control can no longer flow to the next statement, i.e. after a ret, break, cont, or end. Code
+     * parsed while unreachable is discarded instead of emitted
+     */
+    bool reachable;
+
     template <typename... Args>
     void error(TokenIterator tok, Args&&... args) const
     {
@@ -676,8 +1116,12 @@ namespace ss
 
     void write_instruction(Instruction i);
     auto previous() const -> TokenIterator;
+    auto location_of(TokenIterator tok) const noexcept -> SourceLocation;
     void advance() noexcept;
-    void consume(Token::Type type, std::string err);
+    /**
+     * @brief Advances past the expected token. The message is a literal so nothing is allocated unless it is reported
+     */
+    void consume(Token::Type type, const char* err);
     void emit_instruction(Instruction i);
     void emit_constant(Value v);
     auto emit_jump(Instruction i) -> std::size_t;
@@ -708,21 +1152,42 @@ namespace ss
      * @param cont_jmp The instruction to jump to from a continue
      * @param f The function or lambda to call
      */
-    void wrap_loop(std::size_t cont_jmp, auto f);
+    void wrap_loop(std::optional<std::size_t> cont_jmp, auto f);
+    /**
+     * @brief Calls a function that parses as usual, then throws away any code it emitted. Reachability is restored after
+     *
+     * @param f The function or lambda to call
+     */
+    void discard(auto f);
+    /**
+     * @brief Checks if the code emitted since the start is a single literal. If so the literal is removed from the program
+     *
+     * @param start The instruction count before the condition was parsed
+     * @return The truthiness of the literal, or nothing if the condition is not known until runtime
+     */
+    auto fold_condition(std::size_t start) -> std::optional<bool>;
 
-    auto rule_for(Token::Type t) const noexcept -> const ParseRule&;
+    static auto rule_for(Token::Type t) noexcept -> const ParseRule&;
+    /**
+     * @brief Parses declarations until the end of the token list without terminating the program
+     */
+    void parse_declarations();
+    /**
+     * @brief Compiles the file at the path into the program as if its contents were written in place of the load
+     */
+    void load_file(std::string path);
     void parse_precedence(Precedence p);
     void make_number(bool can_assign);
     void make_string(bool can_assign);
     void make_variable(bool assign);
     void make_function(std::string name);
     void named_variable(TokenIterator name, bool assign);
-    auto parse_variable(std::string err_msg) -> std::size_t;
+    auto parse_variable(const char* err_msg) -> std::size_t;
     auto parse_arg_list() -> std::size_t;
     /**
      * @brief Defines a new variable.
      *
-     * @param global The index of the global variable in the chunk's constants. When defining a local variable, this will be 0
+     * @param global The index of the global variable in the program's constants. When defining a local variable, this will be 0
      */
     void define_variable(std::size_t global);
     void declare_variable();
@@ -732,8 +1197,18 @@ namespace ss
     void add_local(TokenIterator token) noexcept;
     auto resolve_local(TokenIterator token) const -> VarLookup;
     auto reduce_locals_to_depth(std::size_t depth) -> std::size_t;
+    /**
+     * @brief Counts the locals deeper than the depth without forgetting them, for jumps that leave their scope early
+     */
+    auto locals_above_depth(std::size_t depth) const noexcept -> std::size_t;
 
     void expression();
+
+    /**
+     * @brief Compiles an expression evaluated only for its effects, leaving nothing on the stack
+     */
+    void effect_expression();
+
     void grouping_expr(bool);
     void unary_expr(bool);
     void binary_expr(bool);
@@ -754,21 +1229,66 @@ namespace ss
     void loop_stmt();
     void while_stmt();
     void for_stmt();
+    /**
+     * @brief Checks whether the upcoming for loop clauses are in the counted form without consuming any tokens
+     */
+    auto match_counted_loop() const -> std::optional<CountedLoop>;
+    /**
+     * @brief Emits a counted for loop as FOR_PREP & FOR_LOOP, keeping the limit and step in hidden locals after the counter
+     */
+    void counted_for_stmt(CountedLoop loop);
     void break_stmt();
     void continue_stmt();
     void return_stmt();
     void end_stmt();
     void match_stmt();
+
+    /**
+     * @brief Checks whether every arm of the match about to be parsed is a lone number or string literal
+     */
+    auto is_literal_match() const -> bool;
+
+    /**
+     * @brief Checks whether the right side of the assignment about to be parsed is the variable plus a single operand that
+     * cannot change the variable, in which case the operand can be added onto the variable in place
+     */
+    auto is_in_place_add(TokenIterator name, bool global) const -> bool;
+
+    /**
+     * @brief Emits a match over literal arms as a single MATCH_TABLE dispatch, each arm jumping to the end when done
+     */
+    void literal_match_stmt();
+
+    /**
+     * @brief Tracks a value the parser left on the stack so locals declared above it resolve to the right slots
+     */
+    void add_hidden_local() noexcept;
     void load_stmt();
     void loadr_stmt();
     void fn_stmt();
   };
 
+  /**
+   * @brief Entry point for compiling source into a program. Holds no mutable state, so a single compiler, or many, may compile
+   * into distinct programs from any number of threads at once
+   */
   class Compiler
   {
    public:
-    Compiler() = default;
-    void compile(std::string&& src, BytecodeChunk& chunk, std::string current_file);
+    Compiler();
+    Compiler(LibraryPaths library_paths);
+
+    void compile(std::string&& src, Program& program, std::string current_file) const;
+
+    /**
+     * @brief The directories listed in SS_LIB, or ~/.simple if unset. The environment is read once per process
+     *
+     * @return The library search paths
+     */
+    static auto default_library_paths() -> const LibraryPaths&;
+
+   private:
+    LibraryPaths library_paths;
   };
 
 }  // namespace ss
\ No newline at end of file
@@ -1,13 +1,33 @@
 #include "datatypes.hpp"
 
 #include "exceptions.hpp"
+#include "util.hpp"
 
+#include <array>
 #include <cmath>
 #include <iomanip>
 #include <sstream>
+#include <string_view>
 
 namespace ss
 {
+  void Object::trace(Heap&) const {}
+
+  namespace
+  {
+    /**
+     * @brief Builds the string in a single allocation from the resource
+     */
+    auto concat(std::pmr::memory_resource* resource, std::string_view a, std::string_view b) -> Value
+    {
+      Value::StringType str(resource);
+      str.reserve(a.size() + b.size());
+      str.append(a);
+      str.append(b);
+      return Value(std::move(str));
+    }
+  }  // namespace
+
   Value::NilType Value::nil;
 
   Value::Value()
@@ -23,11 +43,15 @@ namespace ss
   {}
 
   Value::Value(StringType v)
-   : value(v)
+   : value(std::move(v))
+  {}
+
+  Value::Value(const std::string& v)
+   : Value(StringType(v))
   {}
 
   Value::Value(const char* v)
-   : Value(std::string(v))
+   : Value(StringType(v))
   {}
 
   Value::Value(FunctionType v)
@@ -51,21 +75,19 @@ namespace ss
     }
   }
 
-  auto Value::number() const -> NumberType
+  auto Value::string() const -> std::string
   {
-    if (this->is_type(Type::Number)) {
-      return std::get<NumberType>(this->value);
-    } else {
-      return NumberType();
-    }
+    return std::string(this->string_ref());
   }
 
-  auto Value::string() const -> StringType
+  auto Value::string_ref() const noexcept -> const StringType&
   {
-    if (this->is_type(Type::String)) {
-      return std::get<StringType>(this->value);
+    static const StringType EMPTY;
+
+    if (auto str = std::get_if<StringType>(&this->value)) {
+      return *str;
     } else {
-      return StringType();
+      return EMPTY;
     }
   }
 
@@ -112,6 +134,11 @@ namespace ss
     return true;
   }
 
+  auto Value::allocated_by(const std::pmr::memory_resource* resource) const noexcept -> bool
+  {
+    return this->is_type(Type::String) && std::get<StringType>(this->value).get_allocator().resource() == resource;
+  }
+
   auto Value::to_string() const -> std::string
   {
     switch (this->type()) {
@@ -126,12 +153,11 @@ namespace ss
         }
       }
       case Type::Number: {
-        std::stringstream ss;
-        ss << std::get<NumberType>(this->value);
-        return ss.str();
+        std::array<char, util::NUMBER_BUFFER_SIZE> buffer;
+        return std::string(util::format_number(std::get<NumberType>(this->value), buffer));
       }
       case Type::String: {
-        return std::get<StringType>(this->value);
+        return std::string(std::get<StringType>(this->value));
       }
       case Type::Function: {
         return std::get<FunctionType>(this->value)->to_string();
@@ -170,6 +196,11 @@ namespace ss
   }
 
   auto Value::operator+(const Value& other) const -> Value
+  {
+    return this->add(other, std::pmr::get_default_resource());
+  }
+
+  auto Value::add(const Value& other, std::pmr::memory_resource* resource) const -> Value
   {
     switch (this->type()) {
       case Type::Number: {
@@ -180,35 +211,25 @@ namespace ss
             return Value(a + b);
           }
           case Type::String: {
-            auto b = std::get<StringType>(other.value);
-            std::stringstream ss;
-            ss << a << b;
-            return Value(ss.str());
+            std::array<char, util::NUMBER_BUFFER_SIZE> buffer;
+            return concat(resource, util::format_number(a, buffer), std::get<StringType>(other.value));
           }
           default:
             break;
         }
       } break;
       case Type::String: {
-        auto a = std::get<StringType>(this->value);
+        const auto& a = std::get<StringType>(this->value);
         switch (other.type()) {
           case Type::Number: {
-            auto b = std::get<NumberType>(other.value);
-            std::stringstream ss;
-            ss << a << b;
-            return Value(ss.str());
+            std::array<char, util::NUMBER_BUFFER_SIZE> buffer;
+            return concat(resource, a, util::format_number(std::get<NumberType>(other.value), buffer));
           }
           case Type::String: {
-            auto b = std::get<StringType>(other.value);
-            std::stringstream ss;
-            ss << a << b;
-            return Value(ss.str());
+            return concat(resource, a, std::get<StringType>(other.value));
           }
           case Type::Bool: {
-            auto b = std::get<BoolType>(other.value);
-            std::stringstream ss;
-            ss << a << (b ? "true" : "false");
-            return Value(ss.str());
+            return concat(resource, a, std::get<BoolType>(other.value) ? "true" : "false");
           }
           default:
             break;
@@ -218,10 +239,7 @@ namespace ss
         auto a = std::get<BoolType>(this->value);
         switch (other.type()) {
           case Type::String: {
-            auto b = std::get<StringType>(other.value);
-            std::stringstream ss;
-            ss << (a ? "true" : "false") << b;
-            return Value(ss.str());
+            return concat(resource, a ? "true" : "false", std::get<StringType>(other.value));
           }
           default:
             break;
@@ -234,6 +252,43 @@ namespace ss
     return Value();
   }
 
+  auto Value::operator+=(const Value& other) -> Value&
+  {
+    switch (this->type()) {
+      case Type::Number: {
+        if (other.is_type(Type::Number)) {
+          std::get<NumberType>(this->value) += std::get<NumberType>(other.value);
+          return *this;
+        }
+      } break;
+      case Type::String: {
+        auto& a = std::get<StringType>(this->value);
+        switch (other.type()) {
+          case Type::Number: {
+            std::array<char, util::NUMBER_BUFFER_SIZE> buffer;
+            a.append(util::format_number(std::get<NumberType>(other.value), buffer));
+            return *this;
+          }
+          case Type::String: {
+            a.append(std::get<StringType>(other.value));
+            return *this;
+          }
+          case Type::Bool: {
+            a.append(std::get<BoolType>(other.value) ? "true" : "false");
+            return *this;
+          }
+          default:
+            break;
+        }
+      } break;
+      default:
+        break;
+    }
+
+    // the result is a different type, such as a number plus a string
+    return *this = *this + other;
+  }
+
   auto Value::operator-(const Value& other) const -> Value
   {
     switch (this->type()) {
@@ -266,23 +321,23 @@ namespace ss
             return Value(a * b);
           }
           case Type::String: {
-            auto b = std::get<StringType>(other.value);
-            std::stringstream ss;
-            for (double i = 0; i < a; i++) { ss << b; }
-            return Value(ss.str());
+            const auto& b = std::get<StringType>(other.value);
+            StringType str;
+            for (double i = 0; i < a; i++) { str.append(b); }
+            return Value(std::move(str));
           }
           default:
             break;
         }
       } break;
       case Type::String: {
-        auto a = std::get<StringType>(this->value);
+        const auto& a = std::get<StringType>(this->value);
         switch (other.type()) {
           case Type::Number: {
             auto b = std::get<NumberType>(other.value);
-            std::stringstream ss;
-            for (double i = 0; i < b; i++) { ss << a; }
-            return Value(ss.str());
+            StringType str;
+            for (double i = 0; i < b; i++) { str.append(a); }
+            return Value(std::move(str));
           }
           default:
             break;
@@ -357,10 +412,15 @@ namespace ss
 
   auto Value::operator=(StringType v) noexcept -> Value&
   {
-    this->value = v;
+    this->value = std::move(v);
     return *this;
   }
 
+  auto Value::operator=(const std::string& v) noexcept -> Value&
+  {
+    return *this = StringType(v);
+  }
+
   auto Value::operator=(const char* v) noexcept -> Value&
   {
     return *this = StringType(v);
@@ -405,17 +465,7 @@ namespace ss
 
   auto Value::operator<=(const Value& other) const noexcept -> bool
   {
-    return this->value < other.value;
-  }
-
-  auto Value::type() const noexcept -> Type
-  {
-    return static_cast<Type>(this->value.index());
-  }
-
-  auto Value::is_type(Type t) const noexcept -> bool
-  {
-    return this->type() == t;
+    return this->value <= other.value;
   }
 
   auto operator<<(std::ostream& ostream, const Value& value) -> std::ostream&
@@ -423,10 +473,11 @@ namespace ss
     return ostream << value.to_string();
   }
 
-  Function::Function(std::string n, std::size_t a, std::size_t ip) noexcept
+  Function::Function(std::string n, std::size_t a, std::size_t ip, std::size_t m) noexcept
    : name(n)
    , airity(a)
    , instruction_ptr(ip)
+   , max_stack(m)
   {}
 
   auto Function::to_string() const noexcept -> std::string
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <functional>
-#include <memory>
+#include <memory_resource>
 #include <string>
 #include <variant>
 #include <vector>
@@ -10,6 +10,32 @@ namespace ss
 {
   class Function;
   class NativeFunction;
+  class Heap;
+
+  /**
+   * @brief Base of every script visible object that lives on the garbage collected heap
+   */
+  class Object
+  {
+   public:
+    Object()              = default;
+    Object(const Object&) = delete;
+    virtual ~Object()     = default;
+
+    auto operator=(const Object&) -> Object& = delete;
+
+    /**
+     * @brief Marks every object this one references. Objects without references have nothing to do
+     */
+    virtual void trace(Heap& heap) const;
+
+   private:
+    friend class Heap;
+
+    Object* next        = nullptr;
+    std::size_t size    = 0;
+    mutable bool marked = false;
+  };
 
   class Value
   {
@@ -60,9 +86,9 @@ namespace ss
 
     using BoolType           = bool;
     using NumberType         = double;
-    using StringType         = std::string;
-    using FunctionType       = std::shared_ptr<Function>;
-    using NativeFunctionType = std::shared_ptr<NativeFunction>;
+    using StringType         = std::pmr::string;
+    using FunctionType       = Function*;
+    using NativeFunctionType = NativeFunction*;
 
     struct AddressType
     {
@@ -85,29 +111,73 @@ namespace ss
     Value(BoolType v);
     Value(NumberType v);
     Value(StringType v);
+    Value(const std::string& v);
     Value(const char* v);
     Value(FunctionType v);
     Value(NativeFunctionType v);
     Value(AddressType v);
 
-    auto type() const noexcept -> Type;
-    auto is_type(Type t) const noexcept -> bool;
+    /**
+     * @brief Defined inline, along with number(), so the interpreter's type checks compile down to a comparison
+     */
+    auto type() const noexcept -> Type
+    {
+      return static_cast<Type>(this->value.index());
+    }
+
+    auto is_type(Type t) const noexcept -> bool
+    {
+      return this->type() == t;
+    }
 
     auto boolean() const -> BoolType;
-    auto number() const -> NumberType;
-    auto string() const -> StringType;
+
+    auto number() const -> NumberType
+    {
+      if (this->is_type(Type::Number)) {
+        return *std::get_if<NumberType>(&this->value);
+      }
+      return NumberType();
+    }
+
+    /**
+     * @brief A copy of the string as a std::string, for the host
+     */
+    auto string() const -> std::string;
+
+    /**
+     * @brief The string as the vm stores it, without copying. Empty when this is not a string
+     */
+    auto string_ref() const noexcept -> const StringType&;
     auto function() const -> FunctionType;
     auto native() const -> NativeFunctionType;
     auto address() const -> AddressType;
 
     auto truthy() const -> bool;
+
+    /**
+     * @brief Whether this is a string whose storage came from the given resource
+     */
+    auto allocated_by(const std::pmr::memory_resource* resource) const noexcept -> bool;
     auto to_string() const -> std::string;
 
     auto operator-() const -> Value;
     auto operator!() const -> Value;
 
     auto operator+(const Value& other) const -> Value;
+
+    /**
+     * @brief Same as operator+, but a resulting string is allocated from the given resource
+     */
+    auto add(const Value& other, std::pmr::memory_resource* resource) const -> Value;
+
     auto operator-(const Value& other) const -> Value;
+
+    /**
+     * @brief Adds in place, appending onto the existing string rather than building a new one
+     */
+    auto operator+=(const Value& other) -> Value&;
+
     auto operator*(const Value& other) const -> Value;
     auto operator/(const Value& other) const -> Value;
     auto operator%(const Value& other) const -> Value;
@@ -116,6 +186,7 @@ namespace ss
     auto operator=(BoolType b) noexcept -> Value&;
     auto operator=(NumberType v) noexcept -> Value&;
     auto operator=(StringType v) noexcept -> Value&;
+    auto operator=(const std::string& v) noexcept -> Value&;
     auto operator=(const char* v) noexcept -> Value&;
     auto operator=(FunctionType v) noexcept -> Value&;
     auto operator=(NativeFunctionType v) noexcept -> Value&;
@@ -135,10 +206,10 @@ namespace ss
 
   auto operator<<(std::ostream& ostream, const Value& value) -> std::ostream&;
 
-  class Function
+  class Function: public Object
   {
    public:
-    Function(std::string name, std::size_t airity, std::size_t ip) noexcept;
+    Function(std::string name, std::size_t airity, std::size_t ip, std::size_t max_stack) noexcept;
     ~Function() = default;
 
     auto to_string() const noexcept -> std::string;
@@ -146,11 +217,15 @@ namespace ss
     const std::string name;
     const std::size_t airity;
     const std::size_t instruction_ptr;
+    /**
+     * @brief The most values the body pushes on top of its frame, made room for when it is called
+     */
+    const std::size_t max_stack;
   };
 
   auto operator<<(std::ostream& ostream, const Function& fn) -> std::ostream&;
 
-  class NativeFunction
+  class NativeFunction: public Object
   {
    public:
     using Args     = std::vector<Value>;
@@ -0,0 +1,179 @@
+#include "gc.hpp"
+
+#include <algorithm>
+#include <memory>
+
+namespace ss
+{
+  Heap::Heap(HeapConfig c)
+   : config(c)
+   , objects(nullptr)
+   , next_collection(c.initial_threshold)
+   , nursery(c.nursery_size)
+  {}
+
+  Heap::~Heap()
+  {
+    while (this->objects != nullptr) {
+      auto next = this->objects->next;
+      delete this->objects;
+      this->objects = next;
+    }
+  }
+
+  auto Heap::should_collect() const noexcept -> bool
+  {
+    return this->stats.bytes >= this->next_collection;
+  }
+
+  auto Heap::should_collect_nursery() const noexcept -> bool
+  {
+    return this->nursery.exhausted();
+  }
+
+  auto Heap::string_resource() noexcept -> std::pmr::memory_resource*
+  {
+    return &this->nursery;
+  }
+
+  void Heap::promote(Value& value)
+  {
+    if (value.allocated_by(&this->nursery)) {
+      // copying a string allocates with the default resource, but assigning the copy would put it right back onto the
+      // nursery the old string was allocated by
+      Value promoted(Value::StringType(value.string_ref()));
+      std::destroy_at(&value);
+      std::construct_at(&value, std::move(promoted));
+      this->stats.strings_promoted++;
+    }
+  }
+
+  void Heap::mark(const Value& value)
+  {
+    switch (value.type()) {
+      case Value::Type::Function: {
+        this->mark(value.function());
+      } break;
+      case Value::Type::Native: {
+        this->mark(value.native());
+      } break;
+      default:
+        break;
+    }
+  }
+
+  void Heap::mark(const Object* object)
+  {
+    // objects not made by a heap, like a program's functions, have no size and may be shared by other heaps
+    if (object == nullptr || object->size == 0 || object->marked) {
+      return;
+    }
+
+    object->marked = true;
+    this->gray.push_back(object);
+  }
+
+  auto Heap::statistics() const noexcept -> const HeapStats&
+  {
+    return this->stats;
+  }
+
+  auto Heap::configuration() const noexcept -> const HeapConfig&
+  {
+    return this->config;
+  }
+
+  void Heap::trace_gray()
+  {
+    // a worklist rather than recursion so deeply nested objects cannot overflow the native stack
+    while (!this->gray.empty()) {
+      auto object = this->gray.back();
+      this->gray.pop_back();
+      object->trace(*this);
+    }
+  }
+
+  void Heap::sweep() noexcept
+  {
+    Object** link = &this->objects;
+    while (*link != nullptr) {
+      auto object = *link;
+      if (object->marked) {
+        object->marked = false;
+        link           = &object->next;
+      } else {
+        *link = object->next;
+        this->stats.objects--;
+        this->stats.bytes -= object->size;
+        this->stats.objects_freed++;
+        this->stats.bytes_freed += object->size;
+        delete object;
+      }
+    }
+
+    this->stats.collections++;
+    this->next_collection = std::max(
+     this->config.initial_threshold, static_cast<std::size_t>(static_cast<double>(this->stats.bytes) * this->config.growth_factor));
+  }
+
+  Nursery::Nursery(std::size_t c, std::pmr::memory_resource* u)
+   : buffer(std::make_unique<std::byte[]>(c))
+   , capacity(c)
+   , offset(0)
+   , spilled(false)
+   , upstream(u)
+  {}
+
+  auto Nursery::exhausted() const noexcept -> bool
+  {
+    return this->spilled;
+  }
+
+  auto Nursery::used() const noexcept -> std::size_t
+  {
+    return this->offset;
+  }
+
+  void Nursery::reset() noexcept
+  {
+    this->offset  = 0;
+    this->spilled = false;
+  }
+
+  auto Nursery::do_allocate(std::size_t bytes, std::size_t alignment) -> void*
+  {
+    // large strings are unlikely to be temporaries and would only force early collections
+    if (bytes > this->capacity / 4) {
+      return this->upstream->allocate(bytes, alignment);
+    }
+
+    auto start = (this->offset + alignment - 1) & ~(alignment - 1);
+    if (start + bytes > this->capacity) {
+      this->spilled = true;
+      return this->upstream->allocate(bytes, alignment);
+    }
+
+    this->offset = start + bytes;
+    return this->buffer.get() + start;
+  }
+
+  void Nursery::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment)
+  {
+    auto begin = this->buffer.get();
+    auto p     = static_cast<std::byte*>(ptr);
+    if (p < begin || p >= begin + this->capacity) {
+      this->upstream->deallocate(ptr, bytes, alignment);
+      return;
+    }
+
+    // a temporary consumed before anything else is allocated, such as an operand of print, comes right back off the top
+    if (p + bytes == begin + this->offset) {
+      this->offset = p - begin;
+    }
+  }
+
+  auto Nursery::do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool
+  {
+    return this == &other;
+  }
+}  // namespace ss
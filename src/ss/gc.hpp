@@ -0,0 +1,175 @@
+#pragma once
+
+#include "datatypes.hpp"
+
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+namespace ss
+{
+  /**
+   * @brief Tunables deciding when the heap collects
+   */
+  struct HeapConfig
+  {
+    /**
+     * @brief Bytes that may be allocated before the first collection
+     */
+    std::size_t initial_threshold = 1 << 20;
+
+    /**
+     * @brief After a collection the next one happens once the live bytes have grown by this factor
+     */
+    double growth_factor = 2.0;
+
+    /**
+     * @brief Bytes of the nursery short lived strings are bump allocated from
+     */
+    std::size_t nursery_size = 1 << 16;
+  };
+
+  struct HeapStats
+  {
+    std::size_t collections   = 0;
+    std::size_t objects       = 0;
+    std::size_t bytes         = 0;
+    std::size_t objects_freed = 0;
+    std::size_t bytes_freed   = 0;
+
+    std::size_t minor_collections = 0;
+    std::size_t strings_promoted  = 0;
+  };
+
+  /**
+   * @brief Bump allocator for temporaries. Freeing the most recent allocation gives its space back, anything else is
+   * reclaimed all at once by reset() after the survivors have been promoted out of it
+   */
+  class Nursery: public std::pmr::memory_resource
+  {
+   public:
+    Nursery(std::size_t capacity, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+    /**
+     * @brief Whether an allocation no longer fit, meaning the survivors should be promoted and the nursery reset
+     */
+    auto exhausted() const noexcept -> bool;
+
+    auto used() const noexcept -> std::size_t;
+
+    /**
+     * @brief Reclaims the whole nursery. Nothing allocated from it may be in use anymore
+     */
+    void reset() noexcept;
+
+   private:
+    std::unique_ptr<std::byte[]> buffer;
+    std::size_t capacity;
+    std::size_t offset;
+    bool spilled;
+    std::pmr::memory_resource* upstream;
+
+    auto do_allocate(std::size_t bytes, std::size_t alignment) -> void* override;
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+    auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override;
+  };
+
+  /**
+   * @brief Owns every script visible object, freeing the ones unreachable from the roots with a mark & sweep
+   */
+  class Heap
+  {
+   public:
+    Heap(HeapConfig config = HeapConfig());
+    Heap(const Heap&) = delete;
+    ~Heap();
+
+    auto operator=(const Heap&) -> Heap& = delete;
+
+    /**
+     * @brief Creates an object owned by the heap. It may be freed by the next collection unless it is reachable from a
+     * root by then
+     */
+    template <std::derived_from<Object> T, typename... Args>
+    auto make(Args&&... args) -> T*
+    {
+      auto object  = new T(std::forward<Args>(args)...);
+      object->size = sizeof(T);
+      object->next = this->objects;
+      this->objects = object;
+
+      this->stats.objects++;
+      this->stats.bytes += sizeof(T);
+
+      return object;
+    }
+
+    /**
+     * @brief Whether enough has been allocated since the last collection to warrant another
+     */
+    auto should_collect() const noexcept -> bool;
+
+    /**
+     * @brief Collects every object not reachable from the roots the function marks
+     */
+    template <typename F>
+    void collect(F&& mark_roots)
+    {
+      mark_roots(*this);
+      this->trace_gray();
+      this->sweep();
+    }
+
+    /**
+     * @brief Whether the nursery has filled up since its survivors were last promoted
+     */
+    auto should_collect_nursery() const noexcept -> bool;
+
+    /**
+     * @brief Promotes the nursery strings the function finds in the roots, then empties the nursery
+     */
+    template <typename F>
+    void collect_nursery(F&& promote_roots)
+    {
+      promote_roots(*this);
+      this->nursery.reset();
+      this->stats.minor_collections++;
+    }
+
+    /**
+     * @brief Resource for short lived strings. Their storage is only valid until the next nursery collection, unless they
+     * are in one of the roots by then
+     */
+    auto string_resource() noexcept -> std::pmr::memory_resource*;
+
+    /**
+     * @brief Moves the value's string out of the nursery, if it is in there
+     */
+    void promote(Value& value);
+
+    void mark(const Value& value);
+
+    /**
+     * @brief Marks the object & everything it references. Objects the heap did not make are ignored
+     */
+    void mark(const Object* object);
+
+    auto statistics() const noexcept -> const HeapStats&;
+
+    auto configuration() const noexcept -> const HeapConfig&;
+
+   private:
+    HeapConfig config;
+    HeapStats stats;
+    Object* objects;
+    std::size_t next_collection;
+    std::vector<const Object*> gray;
+    Nursery nursery;
+
+    void trace_gray();
+    void sweep() noexcept;
+  };
+}  // namespace ss
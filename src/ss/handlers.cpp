@@ -0,0 +1,695 @@
+#include "exceptions.hpp"
+#include "vm.hpp"
+
+#include <array>
+#include <cmath>
+#include <memory>
+
+// clang guarantees a call in tail position becomes a jump, so the handlers can chain into each other forever. Elsewhere each
+// handler returns to a trampoline that calls the next one
+#if defined(__has_cpp_attribute) && __has_cpp_attribute(clang::musttail)
+#  define SS_GUARANTEED_TAIL_CALLS true
+#  define SS_MUSTTAIL [[clang::musttail]]
+#else
+#  define SS_GUARANTEED_TAIL_CALLS false
+#  define SS_MUSTTAIL
+#endif
+
+#define SS_HANDLER(name) void handle_##name(TailCallEngine& e, Program::InstructionIterator ip, Value* top, Value* frame)
+
+// runs the instruction the instruction pointer is at, nothing with a destructor may still be in scope
+#define SS_DISPATCH() SS_MUSTTAIL return handle(e, ip, top, frame)
+
+#define SS_NEXT()                                                                                                              \
+  ++ip;                                                                                                                        \
+  SS_DISPATCH()
+
+namespace ss
+{
+  /**
+   * @brief What the handlers share that does not fit in the argument registers. The instruction pointer, stack top, and
+   * frame are passed from handler to handler instead, and only synced back to the vm before something else may look at them
+   */
+  struct TailCallEngine
+  {
+    TailCallEngine(VM& vm)
+     : vm(vm)
+     , running(vm.program)
+     , program(*this->running)
+     , constants(this->program.constant_data())
+     , code(this->program.begin())
+     , config(vm.config)
+     , context(vm.context)
+     , opcode_profiler(vm.opcode_profiler)
+     , function_profiler(vm.function_profiler)
+     , profile_functions(vm.config.profile().functions)
+     , base(vm.context.stack_base())
+     , limit(vm.context.stack_limit())
+    {}
+
+    VM& vm;
+    // a native may compile more code, replacing the vm's program while this one is still running
+    std::shared_ptr<const Program> running;
+    const Program& program;
+    const Value* constants;
+    Program::InstructionIterator code;
+    VMConfig& config;
+    ExecutionContext& context;
+    OpcodeProfiler& opcode_profiler;
+    FunctionProfiler& function_profiler;
+    bool profile_functions;
+    Value* base;
+    Value* limit;
+
+    // where the trampoline picks up from, unused with guaranteed tail calls
+    Program::InstructionIterator next_ip;
+    Value* next_top   = nullptr;
+    Value* next_frame = nullptr;
+    bool done         = false;
+    Value result;
+
+    void sync(Program::InstructionIterator ip, Value* top, Value* frame) noexcept
+    {
+      this->vm.ip = ip;
+      this->vm.sp = frame - this->base;
+      this->context.set_stack_top(top);
+    }
+
+    // anything given the synced state may have moved the stack
+    void reload(Value*& top, Value*& frame) noexcept
+    {
+      this->base  = this->context.stack_base();
+      this->limit = this->context.stack_limit();
+      top         = this->context.stack_top();
+      frame       = this->base + this->vm.sp;
+    }
+
+    /**
+     * @brief Moves the stack somewhere with room for the frame about to be entered
+     */
+    void reserve(Program::InstructionIterator ip, Value*& top, Value*& frame, std::size_t room)
+    {
+      this->sync(ip, top, frame);
+      this->context.reserve_stack(room);
+      this->reload(top, frame);
+    }
+
+    auto global_name(std::size_t index) const -> Value::StringType
+    {
+      // verified to be a string when compiled
+      return this->constants[index].string_ref();
+    }
+
+    auto defined_global(std::size_t index) -> Value&
+    {
+      auto name = this->global_name(index);
+      auto var  = this->context.find_global(name);
+      if (!this->context.is_global_found(var)) {
+        RuntimeError::throw_err("variable '", name, "' is undefined");
+      }
+      return var->second;
+    }
+
+    void finish(Program::InstructionIterator ip, Value* top, Value* frame)
+    {
+      this->sync(ip, top, frame);
+      this->result = this->vm.finish();
+      this->done   = true;
+    }
+
+    void trace(Program::InstructionIterator ip, Value* top, Value* frame) noexcept
+    {
+      if constexpr (PROFILE_OPCODES) {
+        this->opcode_profiler.enter(ip - this->code, ip->major_opcode);
+      }
+
+      if constexpr (DISASSEMBLE_INSTRUCTIONS) {
+        this->sync(ip, top, frame);
+        if constexpr (PRINT_STACK) {
+          this->context.print_stack(this->config);
+        }
+        this->vm.disassemble_instruction(*ip, ip - this->code);
+      }
+    }
+  };
+
+  namespace
+  {
+    using Handler = void (*)(TailCallEngine& e, Program::InstructionIterator ip, Value* top, Value* frame);
+
+    extern const std::array<Handler, 256> HANDLERS;
+
+    inline void handle(TailCallEngine& e, Program::InstructionIterator ip, Value* top, Value* frame)
+    {
+      if constexpr (PROFILE_OPCODES || DISASSEMBLE_INSTRUCTIONS) {
+        e.trace(ip, top, frame);
+      }
+
+      if constexpr (SS_GUARANTEED_TAIL_CALLS) {
+        SS_MUSTTAIL return HANDLERS[static_cast<std::size_t>(ip->major_opcode)](e, ip, top, frame);
+      } else {
+        e.next_ip    = ip;
+        e.next_top   = top;
+        e.next_frame = frame;
+      }
+    }
+
+    // every frame made room for all it pushes when it was entered
+    inline void push(Value*& top, Value v)
+    {
+      std::construct_at(top++, std::move(v));
+    }
+
+    inline auto pop(Value*& top) -> Value
+    {
+      Value v = std::move(*--top);
+      std::destroy_at(top);
+      return v;
+    }
+
+    inline void pop_n(Value*& top, std::size_t n)
+    {
+      top -= n;
+      std::destroy_n(top, n);
+    }
+
+    SS_HANDLER(NO_OP)
+    {
+      SS_NEXT();
+    }
+
+    SS_HANDLER(CONSTANT)
+    {
+      push(top, e.constants[ip->modifying_bits]);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(NIL)
+    {
+      push(top, Value());
+      SS_NEXT();
+    }
+
+    SS_HANDLER(TRUE)
+    {
+      push(top, Value(true));
+      SS_NEXT();
+    }
+
+    SS_HANDLER(FALSE)
+    {
+      push(top, Value(false));
+      SS_NEXT();
+    }
+
+    SS_HANDLER(POP)
+    {
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(POP_N)
+    {
+      pop_n(top, ip->modifying_bits);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(LOOKUP_LOCAL)
+    {
+      push(top, frame[ip->modifying_bits]);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(ASSIGN_LOCAL)
+    {
+      frame[ip->modifying_bits] = top[-1];
+      SS_NEXT();
+    }
+
+    SS_HANDLER(LOOKUP_GLOBAL)
+    {
+      e.sync(ip, top, frame);
+      push(top, e.defined_global(ip->modifying_bits));
+      SS_NEXT();
+    }
+
+    SS_HANDLER(DEFINE_GLOBAL)
+    {
+      e.sync(ip, top, frame);
+      {
+        auto name = e.global_name(ip->modifying_bits);
+        auto var  = e.context.find_global(name);
+        if (e.context.is_global_found(var)) {
+          RuntimeError::throw_err("variable '", name, "' is already defined");
+        }
+        e.context.set_global(std::move(name), pop(top));
+      }
+      SS_NEXT();
+    }
+
+    SS_HANDLER(ASSIGN_GLOBAL)
+    {
+      e.sync(ip, top, frame);
+      e.defined_global(ip->modifying_bits) = top[-1];
+      SS_NEXT();
+    }
+
+    SS_HANDLER(ADD_ASSIGN_LOCAL)
+    {
+      auto index  = add_assign_index(ip->modifying_bits);
+      auto& local = frame[index];
+      if (local.is_type(Value::Type::Number) && top[-1].is_type(Value::Type::Number)) {
+        local = local.number() + top[-1].number();
+      } else {
+        // the operand stays on the stack until the add is done, in case it throws
+        e.sync(ip, top, frame);
+        local += top[-1];
+      }
+      pop_n(top, 1);
+      if (add_assign_pushes(ip->modifying_bits)) {
+        push(top, frame[index]);
+      }
+      SS_NEXT();
+    }
+
+    SS_HANDLER(ADD_ASSIGN_GLOBAL)
+    {
+      e.sync(ip, top, frame);
+      {
+        auto& var = e.defined_global(add_assign_index(ip->modifying_bits));
+        var += top[-1];
+        pop_n(top, 1);
+        if (add_assign_pushes(ip->modifying_bits)) {
+          push(top, var);
+        }
+      }
+      SS_NEXT();
+    }
+
+    SS_HANDLER(EQUAL)
+    {
+      top[-2] = top[-2] == top[-1];
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(NOT_EQUAL)
+    {
+      top[-2] = top[-2] != top[-1];
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(GREATER)
+    {
+      top[-2] = top[-2] > top[-1];
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(GREATER_EQUAL)
+    {
+      top[-2] = top[-2] >= top[-1];
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(LESS)
+    {
+      top[-2] = top[-2] < top[-1];
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(LESS_EQUAL)
+    {
+      top[-2] = top[-2] <= top[-1];
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(CHECK)
+    {
+      top[-1] = top[-2] == top[-1];
+      SS_NEXT();
+    }
+
+    SS_HANDLER(ADD)
+    {
+      if (top[-2].is_type(Value::Type::Number) && top[-1].is_type(Value::Type::Number)) {
+        top[-2] = top[-2].number() + top[-1].number();
+      } else {
+        // promoting the nursery's survivors searches the stack
+        e.sync(ip, top, frame);
+        auto sum = top[-2].add(top[-1], e.context.string_resource());
+        // assigning would copy the sum onto the left operand's resource, constructing keeps it in the nursery
+        std::destroy_at(&top[-2]);
+        std::construct_at(&top[-2], std::move(sum));
+      }
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(SUB)
+    {
+      if (top[-2].is_type(Value::Type::Number) && top[-1].is_type(Value::Type::Number)) {
+        top[-2] = top[-2].number() - top[-1].number();
+      } else {
+        e.sync(ip, top, frame);
+        top[-2] = top[-2] - top[-1];
+      }
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(MUL)
+    {
+      if (top[-2].is_type(Value::Type::Number) && top[-1].is_type(Value::Type::Number)) {
+        top[-2] = top[-2].number() * top[-1].number();
+      } else {
+        e.sync(ip, top, frame);
+        top[-2] = top[-2] * top[-1];
+      }
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(DIV)
+    {
+      if (top[-2].is_type(Value::Type::Number) && top[-1].is_type(Value::Type::Number)) {
+        top[-2] = top[-2].number() / top[-1].number();
+      } else {
+        e.sync(ip, top, frame);
+        top[-2] = top[-2] / top[-1];
+      }
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(MOD)
+    {
+      if (top[-2].is_type(Value::Type::Number) && top[-1].is_type(Value::Type::Number)) {
+        top[-2] = std::fmod(top[-2].number(), top[-1].number());
+      } else {
+        e.sync(ip, top, frame);
+        top[-2] = top[-2] % top[-1];
+      }
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(NOT)
+    {
+      top[-1] = !top[-1];
+      SS_NEXT();
+    }
+
+    SS_HANDLER(NEGATE)
+    {
+      if (top[-1].is_type(Value::Type::Number)) {
+        top[-1] = -top[-1].number();
+      } else {
+        e.sync(ip, top, frame);
+        top[-1] = -top[-1];
+      }
+      SS_NEXT();
+    }
+
+    SS_HANDLER(PRINT)
+    {
+      e.sync(ip, top, frame);
+      e.config.print_line(top[-1].to_string());
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(SWAP)
+    {
+      std::swap(top[-1], top[-2]);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(MOVE)
+    {
+      // shift the value down, useful for returning
+      top[-1 - static_cast<std::ptrdiff_t>(ip->modifying_bits)] = top[-1];
+      SS_NEXT();
+    }
+
+    SS_HANDLER(JUMP)
+    {
+      ip += ip->modifying_bits;
+      SS_DISPATCH();
+    }
+
+    SS_HANDLER(JUMP_IF_FALSE)
+    {
+      if (!top[-1].truthy()) {
+        ip += ip->modifying_bits;
+        SS_DISPATCH();
+      }
+      SS_NEXT();
+    }
+
+    SS_HANDLER(LOOP)
+    {
+      ip -= ip->modifying_bits;
+      SS_DISPATCH();
+    }
+
+    SS_HANDLER(FOR_PREP)
+    {
+      if (!for_loop_continues(for_loop_comparison(ip->modifying_bits), top[-3], top[-2])) {
+        ip += for_loop_offset(ip->modifying_bits);
+        SS_DISPATCH();
+      }
+      SS_NEXT();
+    }
+
+    SS_HANDLER(FOR_LOOP)
+    {
+      auto comparison = for_loop_comparison(ip->modifying_bits);
+      bool ascending  = comparison == ForComparison::LESS || comparison == ForComparison::LESS_EQUAL;
+      Value& counter  = top[-3];
+      Value& limit    = top[-2];
+      Value& step     = top[-1];
+
+      bool again;
+      if (counter.is_type(Value::Type::Number) && limit.is_type(Value::Type::Number)) {
+        Value::NumberType next = ascending ? counter.number() + step.number() : counter.number() - step.number();
+        counter                = next;
+        again                  = for_loop_continues(comparison, next, limit.number());
+      } else {
+        // the body assigned something other than a number to the counter, behave as the unfused loop would
+        e.sync(ip, top, frame);
+        counter = ascending ? counter + step : counter - step;
+        again   = for_loop_continues(comparison, counter, limit);
+      }
+
+      if (again) {
+        ip -= for_loop_offset(ip->modifying_bits);
+        SS_DISPATCH();
+      }
+      SS_NEXT();
+    }
+
+    SS_HANDLER(MATCH_TABLE)
+    {
+      ip += e.program.jump_table_at(ip->modifying_bits).offset_for(top[-1]);
+      SS_DISPATCH();
+    }
+
+    SS_HANDLER(OR)
+    {
+      if (top[-1].truthy()) {
+        ip += ip->modifying_bits;
+        SS_DISPATCH();
+      }
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(AND)
+    {
+      if (!top[-1].truthy()) {
+        ip += ip->modifying_bits;
+        SS_DISPATCH();
+      }
+      pop_n(top, 1);
+      SS_NEXT();
+    }
+
+    SS_HANDLER(PUSH_SP)
+    {
+      push(top, Value{Value::AddressType{static_cast<std::size_t>(frame - e.base)}});
+      // - 1 for the fn on the stack, - 1 for the pushed stack pointer
+      frame = top - ip->modifying_bits - 1 - 1;
+      SS_NEXT();
+    }
+
+    SS_HANDLER(CALL)
+    {
+      {
+        auto fn_val = top[-3 - static_cast<std::ptrdiff_t>(ip->modifying_bits)];
+        switch (fn_val.type()) {
+          case Value::Type::Function: {
+            auto fn = fn_val.function();
+            if (ip->modifying_bits != fn->airity) {
+              e.sync(ip, top, frame);
+              RuntimeError::throw_err(
+               "tried calling function with incorrect number of args, expected ", fn->airity, ", got ", ip->modifying_bits);
+            }
+            if (static_cast<std::size_t>(e.limit - top) < fn->max_stack) [[unlikely]] {
+              e.reserve(ip, top, frame, fn->max_stack);
+            }
+            if (e.profile_functions) [[unlikely]] {
+              e.function_profiler.enter(fn->name);
+            }
+            ip = e.code + fn->instruction_ptr;
+          } break;
+          case Value::Type::Native: {
+            auto fn = fn_val.native();
+            if (ip->modifying_bits != fn->airity) {
+              e.sync(ip, top, frame);
+              RuntimeError::throw_err(
+               "tried calling function with incorrect number of args, expected ", fn->airity, ", got ", ip->modifying_bits);
+            }
+            std::vector<Value> args;
+            // remove the return address & restore the stack pointer the call saved
+            pop_n(top, 1);
+            frame = e.base + pop(top).address().ptr;
+            // push arguments into vector, copied so nothing native code keeps can point into the nursery
+            for (std::size_t i = 0; i < fn->airity; i++) { args.push_back(top[-1 - static_cast<std::ptrdiff_t>(i)]); }
+            if (e.profile_functions) [[unlikely]] {
+              e.function_profiler.enter(fn->name);
+            }
+            // the native may call back into the vm or collect garbage, so the arguments & function stay on the stack to
+            // keep them reachable until it returns
+            e.sync(ip, top, frame);
+            auto retval = fn->call(std::move(args));
+            e.reload(top, frame);
+            pop_n(top, fn->airity + 1);
+            push(top, std::move(retval));
+            if (e.profile_functions) [[unlikely]] {
+              e.function_profiler.leave();
+            }
+          } break;
+          default: {
+            e.sync(ip, top, frame);
+            RuntimeError::throw_err("tried calling non-function: ", fn_val);
+          }
+        }
+      }
+      SS_NEXT();
+    }
+
+    SS_HANDLER(RETURN)
+    {
+      {
+        auto local_count = ip->modifying_bits;
+        auto retval      = pop(top);
+
+        // the return address & stack pointer, verified to be where the call left them
+        ip    = e.code + pop(top).address().ptr;
+        frame = e.base + pop(top).address().ptr;
+
+        // remove the locals & function
+        pop_n(top, local_count + 1);
+        push(top, std::move(retval));
+
+        if (e.profile_functions) [[unlikely]] {
+          e.function_profiler.leave();
+        }
+      }
+      SS_DISPATCH();
+    }
+
+    SS_HANDLER(END)
+    {
+      e.finish(ip, top, frame);
+    }
+
+    SS_HANDLER(INVALID)
+    {
+      e.sync(ip, top, frame);
+      RuntimeError::throw_err("invalid op code: ", static_cast<std::size_t>(ip->major_opcode));
+    }
+
+    constexpr auto make_handlers() noexcept -> std::array<Handler, 256>
+    {
+      std::array<Handler, 256> handlers{};
+      handlers.fill(&handle_INVALID);
+
+#define SS_REGISTER(name) handlers[static_cast<std::size_t>(OpCode::name)] = &handle_##name;
+      SS_REGISTER(NO_OP)
+      SS_REGISTER(CONSTANT)
+      SS_REGISTER(NIL)
+      SS_REGISTER(TRUE)
+      SS_REGISTER(FALSE)
+      SS_REGISTER(POP)
+      SS_REGISTER(POP_N)
+      SS_REGISTER(LOOKUP_LOCAL)
+      SS_REGISTER(ASSIGN_LOCAL)
+      SS_REGISTER(LOOKUP_GLOBAL)
+      SS_REGISTER(DEFINE_GLOBAL)
+      SS_REGISTER(ASSIGN_GLOBAL)
+      SS_REGISTER(ADD_ASSIGN_LOCAL)
+      SS_REGISTER(ADD_ASSIGN_GLOBAL)
+      SS_REGISTER(EQUAL)
+      SS_REGISTER(NOT_EQUAL)
+      SS_REGISTER(GREATER)
+      SS_REGISTER(GREATER_EQUAL)
+      SS_REGISTER(LESS)
+      SS_REGISTER(LESS_EQUAL)
+      SS_REGISTER(CHECK)
+      SS_REGISTER(ADD)
+      SS_REGISTER(SUB)
+      SS_REGISTER(MUL)
+      SS_REGISTER(DIV)
+      SS_REGISTER(MOD)
+      SS_REGISTER(NOT)
+      SS_REGISTER(NEGATE)
+      SS_REGISTER(PRINT)
+      SS_REGISTER(SWAP)
+      SS_REGISTER(MOVE)
+      SS_REGISTER(JUMP)
+      SS_REGISTER(JUMP_IF_FALSE)
+      SS_REGISTER(LOOP)
+      SS_REGISTER(FOR_PREP)
+      SS_REGISTER(FOR_LOOP)
+      SS_REGISTER(MATCH_TABLE)
+      SS_REGISTER(OR)
+      SS_REGISTER(AND)
+      SS_REGISTER(PUSH_SP)
+      SS_REGISTER(CALL)
+      SS_REGISTER(RETURN)
+      SS_REGISTER(END)
+#undef SS_REGISTER
+
+      return handlers;
+    }
+
+    const std::array<Handler, 256> HANDLERS = make_handlers();
+  }  // namespace
+
+  template <>
+  auto VM::dispatch<Dispatch::TAIL_CALL>() -> Value
+  {
+    TailCallEngine e(*this);
+    Value* top   = this->context.stack_top();
+    Value* frame = e.base + this->sp;
+
+    if (this->ip >= e.program.end()) {
+      return Value();
+    }
+
+    handle(e, this->ip, top, frame);
+    if constexpr (!SS_GUARANTEED_TAIL_CALLS) {
+      while (!e.done) {
+        HANDLERS[static_cast<std::size_t>(e.next_ip->major_opcode)](e, e.next_ip, e.next_top, e.next_frame);
+      }
+    }
+
+    return std::move(e.result);
+  }
+}  // namespace ss
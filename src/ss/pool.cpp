@@ -0,0 +1,99 @@
+#include "pool.hpp"
+
+namespace ss
+{
+  namespace
+  {
+    auto compile_program(std::string src, const std::filesystem::path& path) -> std::shared_ptr<const Program>
+    {
+      auto program = std::make_shared<Program>();
+      Compiler compiler;
+      compiler.compile(std::move(src), *program, path.string());
+      program->verify(0);
+      return program;
+    }
+  }  // namespace
+
+  VMPool::Lease::Lease(VMPool& p, std::unique_ptr<VM> v) noexcept
+   : pool(&p)
+   , vm(std::move(v))
+  {}
+
+  VMPool::Lease::~Lease()
+  {
+    if (this->vm) {
+      this->pool->release(std::move(this->vm));
+    }
+  }
+
+  auto VMPool::Lease::operator->() const noexcept -> VM*
+  {
+    return this->vm.get();
+  }
+
+  auto VMPool::Lease::operator*() const noexcept -> VM&
+  {
+    return *this->vm;
+  }
+
+  VMPool::VMPool(std::string src, Setup s, VMConfig cfg, HeapConfig hc, std::filesystem::path path)
+   : program(compile_program(std::move(src), path))
+   , script{0, this->program->max_stack_depth(0)}
+   , setup(std::move(s))
+   , config(cfg)
+   , heap_config(hc)
+   , created(0)
+  {}
+
+  auto VMPool::acquire() -> Lease
+  {
+    {
+      std::lock_guard lock(this->mutex);
+      if (!this->idle.empty()) {
+        auto vm = std::move(this->idle.back());
+        this->idle.pop_back();
+        return Lease(*this, std::move(vm));
+      }
+      // so returning a vm never allocates
+      this->idle.reserve(this->created + 1);
+      this->created++;
+    }
+
+    try {
+      return Lease(*this, this->create());
+    } catch (...) {
+      std::lock_guard lock(this->mutex);
+      this->created--;
+      throw;
+    }
+  }
+
+  auto VMPool::size() const noexcept -> std::size_t
+  {
+    std::lock_guard lock(this->mutex);
+    return this->created;
+  }
+
+  auto VMPool::idle_count() const noexcept -> std::size_t
+  {
+    std::lock_guard lock(this->mutex);
+    return this->idle.size();
+  }
+
+  auto VMPool::create() -> std::unique_ptr<VM>
+  {
+    auto vm = std::make_unique<VM>(this->config, this->heap_config);
+    if (this->setup) {
+      this->setup(*vm);
+    }
+    vm->program = this->program;
+    vm->run(this->script);
+    return vm;
+  }
+
+  void VMPool::release(std::unique_ptr<VM> vm) noexcept
+  {
+    std::lock_guard lock(this->mutex);
+    this->idle.push_back(std::move(vm));
+  }
+}  // namespace ss
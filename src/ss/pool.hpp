@@ -0,0 +1,95 @@
+#pragma once
+
+#include "cfg.hpp"
+#include "code.hpp"
+#include "gc.hpp"
+#include "vm.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ss
+{
+  /**
+   * @brief Compiles a script once and hands out vms that already ran it, so a multi-threaded host neither recompiles nor
+   * warms up a vm per request. The vms share the compiled program but each holds its own stack, globals and heap, so any
+   * number can run at once as long as each is used by one thread at a time
+   */
+  class VMPool
+  {
+   public:
+    /**
+     * @brief Runs on every new vm before the script does, such as to define the natives it calls
+     */
+    using Setup = std::function<void(VM&)>;
+
+    /**
+     * @brief A vm checked out of the pool, returned to it when the lease is destroyed. Globals the script assigned keep their
+     * values for whoever checks the vm out next. Use call or run rather than run_script, which discards the pool's code
+     */
+    class Lease
+    {
+     public:
+      Lease(VMPool& pool, std::unique_ptr<VM> vm) noexcept;
+      Lease(Lease&& other) noexcept = default;
+      ~Lease();
+
+      auto operator=(Lease&& other) noexcept -> Lease& = delete;
+
+      auto operator->() const noexcept -> VM*;
+      auto operator*() const noexcept -> VM&;
+
+     private:
+      VMPool* pool;
+      std::unique_ptr<VM> vm;
+    };
+
+    /**
+     * @brief Compiles the script, throwing a CompiletimeError if it is invalid. No vm is created until one is acquired.
+     * Every vm gets a copy of the config, so they all print to the same stream. vms running at once only print safely
+     * through std::cout or a file descriptor set in OutputConfig::fd, any other stream must be synchronized by the host
+     */
+    VMPool(std::string src,
+     Setup setup                = nullptr,
+     VMConfig cfg               = VMConfig::basic,
+     HeapConfig heap_config     = HeapConfig(),
+     std::filesystem::path path = std::filesystem::current_path());
+
+    /**
+     * @brief Checks out an idle vm, or creates one and runs the script on it if every vm is in use. Safe to call from any
+     * thread
+     */
+    auto acquire() -> Lease;
+
+    /**
+     * @brief How many vms the pool has created, checked out or not
+     */
+    auto size() const noexcept -> std::size_t;
+
+    /**
+     * @brief How many vms are waiting to be checked out
+     */
+    auto idle_count() const noexcept -> std::size_t;
+
+   private:
+    /**
+     * @brief Shared by every vm, which only read it, so they are created from it without holding the lock
+     */
+    std::shared_ptr<const Program> program;
+    CompiledScript script;
+    Setup setup;
+    VMConfig config;
+    HeapConfig heap_config;
+
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<VM>> idle;
+    std::size_t created;
+
+    auto create() -> std::unique_ptr<VM>;
+    void release(std::unique_ptr<VM> vm) noexcept;
+  };
+}  // namespace ss
@@ -0,0 +1,237 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
+
+namespace ss
+{
+  auto OpcodeProfiler::now() noexcept -> std::uint64_t
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  void OpcodeProfiler::enter(std::size_t offset, OpCode op) noexcept
+  {
+    auto t = now();
+
+    if (this->timing) {
+      this->charge(t);
+    }
+
+    if (offset >= this->offsets.size()) {
+      this->offsets.resize(offset + 1);
+    }
+
+    this->opcodes[static_cast<std::size_t>(op)].executions++;
+    this->offsets[offset].executions++;
+
+    this->timing         = true;
+    this->current_offset = offset;
+    this->current_op     = op;
+    this->started        = t;
+  }
+
+  void OpcodeProfiler::stop() noexcept
+  {
+    if (this->timing) {
+      this->charge(now());
+      this->timing = false;
+    }
+  }
+
+  void OpcodeProfiler::reset() noexcept
+  {
+    this->opcodes.fill(Counter{});
+    this->offsets.clear();
+    this->timing = false;
+  }
+
+  auto OpcodeProfiler::opcode_counter(OpCode op) const noexcept -> Counter
+  {
+    return this->opcodes[static_cast<std::size_t>(op)];
+  }
+
+  auto OpcodeProfiler::offset_counter(std::size_t offset) const noexcept -> Counter
+  {
+    if (offset < this->offsets.size()) {
+      return this->offsets[offset];
+    } else {
+      return Counter{};
+    }
+  }
+
+  void OpcodeProfiler::report(const Program& program, VMConfig& cfg, std::size_t hot_spots) const
+  {
+    std::vector<std::pair<OpCode, Counter>> by_opcode;
+    for (std::size_t i = 0; i < this->opcodes.size(); i++) {
+      if (this->opcodes[i].executions > 0) {
+        by_opcode.emplace_back(static_cast<OpCode>(i), this->opcodes[i]);
+      }
+    }
+    std::sort(by_opcode.begin(), by_opcode.end(), [](const auto& a, const auto& b) {
+      return a.second.ticks > b.second.ticks;
+    });
+
+    cfg.write_line("OPCODES");
+    cfg.write_line(std::setw(16), std::left, "opcode", std::right, std::setw(14), "executions", std::setw(16), "ticks");
+    cfg.reset_ostream();
+    for (const auto& [op, counter] : by_opcode) {
+      cfg.write_line(std::setw(16), std::left, op, std::right, std::setw(14), counter.executions, std::setw(16), counter.ticks);
+      cfg.reset_ostream();
+    }
+
+    // offsets generated from the same line are summed so the table points at source rather than bytecode
+    std::map<std::pair<std::size_t, std::size_t>, Counter> by_line;
+    for (std::size_t offset = 0; offset < this->offsets.size(); offset++) {
+      const auto& counter = this->offsets[offset];
+      if (counter.executions > 0) {
+        auto location = program.location_at(offset);
+        auto& line    = by_line[{location.file, location.line}];
+        line.executions += counter.executions;
+        line.ticks += counter.ticks;
+      }
+    }
+
+    std::vector<std::pair<std::pair<std::size_t, std::size_t>, Counter>> hottest(by_line.begin(), by_line.end());
+    std::sort(hottest.begin(), hottest.end(), [](const auto& a, const auto& b) {
+      return a.second.ticks > b.second.ticks;
+    });
+    if (hottest.size() > hot_spots) {
+      hottest.resize(hot_spots);
+    }
+
+    cfg.write_line("HOT SPOTS");
+    cfg.write_line(std::setw(32), std::left, "location", std::right, std::setw(14), "executions", std::setw(16), "ticks");
+    cfg.reset_ostream();
+    for (const auto& [where, counter] : hottest) {
+      auto location = program.file_name(where.first) + ":" + std::to_string(where.second);
+      cfg.write_line(
+       std::setw(32), std::left, location, std::right, std::setw(14), counter.executions, std::setw(16), counter.ticks);
+      cfg.reset_ostream();
+    }
+  }
+
+  void OpcodeProfiler::charge(std::uint64_t until) noexcept
+  {
+    auto elapsed = until - this->started;
+    this->opcodes[static_cast<std::size_t>(this->current_op)].ticks += elapsed;
+    this->offsets[this->current_offset].ticks += elapsed;
+  }
+
+  void FunctionProfiler::enter(const std::string& name)
+  {
+    auto path_length = this->path.size();
+    if (!this->frames.empty()) {
+      this->path.push_back(';');
+    }
+    this->path.append(name);
+
+    this->frames.push_back(Frame{name, path_length, OpcodeProfiler::now(), 0});
+  }
+
+  void FunctionProfiler::leave() noexcept
+  {
+    if (this->frames.empty()) {
+      return;
+    }
+
+    auto frame     = std::move(this->frames.back());
+    auto inclusive = OpcodeProfiler::now() - frame.started;
+    auto exclusive = inclusive - std::min(inclusive, frame.children);
+    this->frames.pop_back();
+
+    auto& timing = this->functions[frame.name];
+    timing.calls++;
+    // recursive calls are already counted by the outermost one
+    bool recursive = std::any_of(this->frames.begin(), this->frames.end(), [&frame](const Frame& outer) {
+      return outer.name == frame.name;
+    });
+    if (!recursive) {
+      timing.inclusive += inclusive;
+    }
+    timing.exclusive += exclusive;
+
+    this->stacks[this->path] += exclusive;
+    this->path.resize(frame.path_length);
+
+    if (!this->frames.empty()) {
+      this->frames.back().children += inclusive;
+    }
+  }
+
+  void FunctionProfiler::stop() noexcept
+  {
+    this->unwind(0);
+  }
+
+  void FunctionProfiler::unwind(std::size_t depth) noexcept
+  {
+    while (this->frames.size() > depth) { this->leave(); }
+  }
+
+  auto FunctionProfiler::depth() const noexcept -> std::size_t
+  {
+    return this->frames.size();
+  }
+
+  void FunctionProfiler::reset() noexcept
+  {
+    this->frames.clear();
+    this->path.clear();
+    this->functions.clear();
+    this->stacks.clear();
+  }
+
+  auto FunctionProfiler::timing(const std::string& name) const noexcept -> Timing
+  {
+    auto entry = this->functions.find(name);
+    if (entry != this->functions.end()) {
+      return entry->second;
+    } else {
+      return Timing{};
+    }
+  }
+
+  void FunctionProfiler::report(VMConfig& cfg) const
+  {
+    std::vector<std::pair<std::string, Timing>> by_function(this->functions.begin(), this->functions.end());
+    std::sort(by_function.begin(), by_function.end(), [](const auto& a, const auto& b) {
+      return a.second.exclusive > b.second.exclusive;
+    });
+
+    cfg.write_line("FUNCTIONS");
+    cfg.write_line(
+     std::setw(24), std::left, "function", std::right, std::setw(12), "calls", std::setw(16), "inclusive", std::setw(16), "exclusive");
+    cfg.reset_ostream();
+    for (const auto& [name, timing] : by_function) {
+      cfg.write_line(
+       std::setw(24),
+       std::left,
+       name,
+       std::right,
+       std::setw(12),
+       timing.calls,
+       std::setw(16),
+       timing.inclusive,
+       std::setw(16),
+       timing.exclusive);
+      cfg.reset_ostream();
+    }
+  }
+
+  void FunctionProfiler::write_folded(std::ostream& ostream) const
+  {
+    for (const auto& [stack, ticks] : this->stacks) { ostream << stack << ' ' << ticks << '\n'; }
+  }
+}  // namespace ss
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "cfg.hpp"
+#include "code.hpp"
+
+#include <array>
+#include <cinttypes>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ss
+{
+  /**
+   * @brief Counts and times every instruction the VM dispatches. The VM only feeds it when PROFILE_OPCODES is enabled, so
+   * it costs nothing otherwise
+   */
+  class OpcodeProfiler
+  {
+   public:
+    struct Counter
+    {
+      std::uint64_t executions = 0;
+      /**
+       * @brief Time spent in the instruction, in cycles where the cpu has a timestamp counter and nanoseconds otherwise
+       */
+      std::uint64_t ticks = 0;
+    };
+
+    /**
+     * @brief Reads the timestamp counter, or a steady clock where there is none
+     */
+    static auto now() noexcept -> std::uint64_t;
+
+    /**
+     * @brief Records the instruction about to be dispatched, charging the time since the last one to that instruction
+     */
+    void enter(std::size_t offset, OpCode op) noexcept;
+
+    /**
+     * @brief Charges the time since the last dispatch to that instruction and stops timing
+     */
+    void stop() noexcept;
+
+    /**
+     * @brief Discards everything recorded so far
+     */
+    void reset() noexcept;
+
+    auto opcode_counter(OpCode op) const noexcept -> Counter;
+
+    auto offset_counter(std::size_t offset) const noexcept -> Counter;
+
+    /**
+     * @brief Writes the totals per opcode, then the hottest source lines found through the location table of the program
+     */
+    void report(const Program& program, VMConfig& cfg, std::size_t hot_spots = 10) const;
+
+   private:
+    std::array<Counter, static_cast<std::size_t>(OpCode::END) + 1> opcodes;
+    std::vector<Counter> offsets;
+
+    bool timing                = false;
+    std::size_t current_offset = 0;
+    OpCode current_op          = OpCode::NO_OP;
+    std::uint64_t started      = 0;
+
+    void charge(std::uint64_t until) noexcept;
+  };
+
+  /**
+   * @brief Times every script and native function call. The VM only feeds it when its config's profile asks for functions
+   */
+  class FunctionProfiler
+  {
+   public:
+    struct Timing
+    {
+      std::uint64_t calls = 0;
+      /**
+       * @brief Ticks spent in the function including its callees
+       */
+      std::uint64_t inclusive = 0;
+      /**
+       * @brief Ticks spent in the function itself
+       */
+      std::uint64_t exclusive = 0;
+    };
+
+    /**
+     * @brief Pushes a call to the named function onto the profiled call stack
+     */
+    void enter(const std::string& name);
+
+    /**
+     * @brief Pops the innermost call, charging its time to it and to its call stack
+     */
+    void leave() noexcept;
+
+    /**
+     * @brief Pops every call still on the profiled call stack
+     */
+    void stop() noexcept;
+
+    /**
+     * @brief Pops calls until only the given number are left, such as those an error unwound past
+     */
+    void unwind(std::size_t depth) noexcept;
+
+    /**
+     * @brief How many calls are on the profiled call stack
+     */
+    auto depth() const noexcept -> std::size_t;
+
+    /**
+     * @brief Discards everything recorded so far
+     */
+    void reset() noexcept;
+
+    auto timing(const std::string& name) const noexcept -> Timing;
+
+    /**
+     * @brief Writes the calls per function with their inclusive & exclusive ticks, most expensive first
+     */
+    void report(VMConfig& cfg) const;
+
+    /**
+     * @brief Writes one line per distinct call stack, frames separated by ';' and followed by the exclusive ticks, the
+     * folded format flamegraph.pl consumes
+     */
+    void write_folded(std::ostream& ostream) const;
+
+   private:
+    struct Frame
+    {
+      std::string name;
+      std::size_t path_length;
+      std::uint64_t started;
+      std::uint64_t children;
+    };
+
+    std::vector<Frame> frames;
+    std::string path;
+    std::unordered_map<std::string, Timing> functions;
+    std::map<std::string, std::uint64_t> stacks;
+  };
+}  // namespace ss
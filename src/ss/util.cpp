@@ -1,5 +1,6 @@
 #include "util.hpp"
 
+#include <charconv>
 #include <fstream>
 
 namespace ss
@@ -15,5 +16,17 @@ namespace ss
       std::copy(input_iter, empty_iter, string_inserter);
       return contents;
     }
+
+    auto format_number(double number, std::array<char, NUMBER_BUFFER_SIZE>& buffer) noexcept -> std::string_view
+    {
+      auto [end, _] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), number, std::chars_format::general, 6);
+      return std::string_view(buffer.data(), end - buffer.data());
+    }
+
+    auto parse_number(std::string_view text, double& number) noexcept -> bool
+    {
+      auto [end, err] = std::from_chars(text.data(), text.data() + text.size(), number);
+      return err == std::errc() && end == text.data() + text.size();
+    }
   }  // namespace util
 }  // namespace ss
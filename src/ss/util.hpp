@@ -1,6 +1,8 @@
 #pragma once
 
+#include <array>
 #include <string>
+#include <string_view>
 
 namespace ss
 {
@@ -19,5 +21,20 @@ namespace ss
     }
 
     auto load_file_to_string(std::string filename) -> std::string;
+
+    /**
+     * @brief Large enough for anything format_number writes
+     */
+    constexpr std::size_t NUMBER_BUFFER_SIZE = 32;
+
+    /**
+     * @brief Writes the number the same as an ostream does by default, %g with a precision of 6, without the stream
+     */
+    auto format_number(double number, std::array<char, NUMBER_BUFFER_SIZE>& buffer) noexcept -> std::string_view;
+
+    /**
+     * @brief Parses the entire text as a number, returning false if any of it is not part of one
+     */
+    auto parse_number(std::string_view text, double& number) noexcept -> bool;
   }  // namespace util
 }  // namespace ss
\ No newline at end of file
@@ -3,10 +3,13 @@
 #include "exceptions.hpp"
 #include "util.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <exception>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 
 #define SS_SIMPLE_PRINT_CASE(name)                                                                                             \
@@ -20,19 +23,121 @@
 
 namespace ss
 {
-  VM::VM(VMConfig cfg)
+  namespace
+  {
+    /**
+     * @brief Whether the op code has a handler for a cached top, any other spills it to the stack before running
+     */
+    constexpr auto reads_cached_top(OpCode op) noexcept -> bool
+    {
+      switch (op) {
+        case OpCode::NO_OP:
+        case OpCode::CONSTANT:
+        case OpCode::POP:
+        case OpCode::LOOKUP_LOCAL:
+        case OpCode::ASSIGN_LOCAL:
+        case OpCode::ADD_ASSIGN_LOCAL:
+        case OpCode::EQUAL:
+        case OpCode::NOT_EQUAL:
+        case OpCode::GREATER:
+        case OpCode::GREATER_EQUAL:
+        case OpCode::LESS:
+        case OpCode::LESS_EQUAL:
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MUL:
+        case OpCode::DIV:
+        case OpCode::MOD:
+        case OpCode::NEGATE:
+        case OpCode::JUMP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::LOOP:
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    /**
+     * @brief Counts an execution as in progress until it returns or throws
+     */
+    class ExecutingGuard
+    {
+     public:
+      ExecutingGuard(std::size_t& e) noexcept
+       : executing(e)
+      {
+        this->executing++;
+      }
+
+      ~ExecutingGuard()
+      {
+        this->executing--;
+      }
+
+     private:
+      std::size_t& executing;
+    };
+
+    /**
+     * @brief Compiles the script after the code already in the program, verifying it before it can be run
+     */
+    auto compile_into(Program& program, std::string src, const std::filesystem::path& path) -> CompiledScript
+    {
+      Compiler compiler;
+      CompiledScript script{program.instruction_count(), 0};
+      compiler.compile(std::move(src), program, path.string());
+      program.verify(script.entry);
+      script.max_stack = program.max_stack_depth(script.entry);
+      return script;
+    }
+
+    /**
+     * @brief Flushes the script's output once execution stops, whether it ended or an error was thrown
+     */
+    class FlushGuard
+    {
+     public:
+      FlushGuard(VMConfig& c) noexcept
+       : config(c)
+      {}
+
+      ~FlushGuard()
+      {
+        this->config.flush();
+      }
+
+     private:
+      VMConfig& config;
+    };
+  }  // namespace
+
+  VM::VM(VMConfig cfg, HeapConfig heap_config)
    : config(cfg)
+   , program(std::make_shared<Program>())
+   , context(heap_config)
    , sp(0)
+   , executing(0)
   {}
 
-  void VM::set_var(Value::StringType name, Value value) noexcept
+  void VM::collect_garbage()
+  {
+    this->context.collect_garbage();
+  }
+
+  auto VM::heap_stats() const noexcept -> const HeapStats&
   {
-    this->chunk.set_global(std::move(name), value);
+    return this->context.heap_stats();
   }
 
-  auto VM::get_var(Value::StringType name) noexcept -> Value
+  void VM::set_var(std::string_view name, Value value) noexcept
   {
-    return this->chunk.find_global(name)->second;
+    this->context.set_global(Value::StringType(name), value);
+  }
+
+  auto VM::get_var(std::string_view name) noexcept -> Value
+  {
+    return this->context.find_global(Value::StringType(name))->second;
   }
 
   auto VM::repl(VMConfig cfg) -> int
@@ -74,309 +179,777 @@ namespace ss
 
   auto VM::run_script(std::string src, std::filesystem::path path) -> Value
   {
-    this->chunk.prepare();
-    this->compile(path.string(), std::move(src));
-    this->ip = this->chunk.begin();
-    return this->execute();
+    this->context.prepare();
+    // functions of the old program may still be in the globals
+    this->context.retain_functions(*this->program);
+    this->program = std::make_shared<Program>();
+    return this->run(this->compile(std::move(src), path));
   }
 
   void VM::run_line(std::string line)
   {
-    std::filesystem::path cwd = std::filesystem::current_path();
-    std::size_t offset        = this->chunk.instruction_count();
-    this->compile(cwd.string(), std::move(line));
-    this->ip = this->chunk.begin() + offset;
-    this->execute();
+    this->run(this->compile(std::move(line)));
+  }
+
+  auto VM::compile(std::string src, std::filesystem::path path) -> CompiledScript
+  {
+    if (this->program.use_count() > 1) {
+      // another vm or a running loop still reads it, so the code goes into a copy. The copy shares the functions already
+      // defined, so they stay valid in either program
+      auto program  = std::make_shared<Program>(*this->program);
+      auto script   = compile_into(*program, std::move(src), path);
+      this->program = std::move(program);
+      return script;
+    }
+
+    // nothing else can see it, so the code is appended in place and rolled back if it fails. Every program is created
+    // mutable, only published as const
+    auto& program   = *std::const_pointer_cast<Program>(this->program);
+    auto checkpoint = program.checkpoint();
+    try {
+      return compile_into(program, std::move(src), path);
+    } catch (...) {
+      program.rollback(checkpoint);
+      throw;
+    }
   }
 
-  void VM::compile(std::string filename, std::string&& src)
+  auto VM::run(CompiledScript script) -> Value
   {
-    Compiler compiler;
+    this->ip = this->program->instruction_at(script.entry);
+    this->context.reserve_stack(script.max_stack);
+
+    // code a native runs is part of the run that called it
+    if (this->executing > 0) {
+      return this->execute();
+    }
+
+    auto saved_sp         = this->sp;
+    auto saved_stack_size = this->context.stack_size();
 
-    compiler.compile(std::move(src), this->chunk, filename);
+    this->start_profile();
+    Value retval;
+    try {
+      retval = this->execute();
+    } catch (...) {
+      // the error left the stack as it was when thrown, the next run starts from where this one did
+      this->context.pop_stack_n(this->context.stack_size() - saved_stack_size);
+      this->sp = saved_sp;
+      throw;
+    }
+    this->finish_profile();
+    return retval;
+  }
+
+  auto VM::call(Value fn, NativeFunction::Args args) -> Value
+  {
+    switch (fn.type()) {
+      case Value::Type::Function: {
+        auto function = fn.function();
+        if (args.size() != function->airity) {
+          RuntimeError::throw_err(
+           "tried calling function with incorrect number of args, expected ", function->airity, ", got ", args.size());
+        }
+
+        // a native function calling back into the script is in the middle of executing it
+        auto saved_ip         = this->ip;
+        auto saved_sp         = this->sp;
+        auto saved_stack_size = this->context.stack_size();
+
+        // the same frame a script's call builds
+        this->context.push_stack(fn);
+        for (auto& arg : args) { this->context.push_stack(std::move(arg)); }
+        this->context.push_stack(Value{Value::AddressType{this->sp}});
+        this->sp = saved_stack_size;
+        this->context.push_stack(Value{Value::AddressType{this->host_return_address()}});
+        this->context.reserve_stack(function->max_stack);
+
+        // the function's first instruction is the one after its pointer
+        this->ip = this->program->instruction_at(function->instruction_ptr) + 1;
+
+        // its RETURN leaves the call
+        auto saved_depth = this->function_profiler.depth();
+        if (this->config.profile().functions) {
+          this->function_profiler.enter(function->name);
+        }
+
+        Value retval;
+        try {
+          retval = this->execute();
+        } catch (...) {
+          // leave the vm as it was so the host can keep calling
+          this->context.pop_stack_n(this->context.stack_size() - saved_stack_size);
+          this->ip = saved_ip;
+          this->sp = saved_sp;
+          this->function_profiler.unwind(saved_depth);
+          throw;
+        }
+
+        this->ip = saved_ip;
+        return retval;
+      }
+      case Value::Type::Native: {
+        auto native = fn.native();
+        if (args.size() != native->airity) {
+          RuntimeError::throw_err(
+           "tried calling function with incorrect number of args, expected ", native->airity, ", got ", args.size());
+        }
+        // natives called by a script see the last argument first
+        std::reverse(args.begin(), args.end());
+        return native->call(std::move(args));
+      }
+      default: {
+        RuntimeError::throw_err("tried calling non-function: ", fn);
+      }
+    }
+
+    return Value();
+  }
+
+  auto VM::host_return_address() -> std::size_t
+  {
+    // every compile terminates the program with one
+    auto count = this->program->instruction_count();
+    if (count == 0 || this->program->instruction_at(count - 1)->major_opcode != OpCode::END) {
+      RuntimeError::throw_err("tried calling a function with no compiled code to return to");
+    }
+    return count - 1;
   }
 
   auto VM::execute() -> Value
   {
     if constexpr (DISASSEMBLE_CHUNK) {
-      this->disassemble_chunk();
+      this->disassemble_program();
     }
     if constexpr (PRINT_CONSTANTS) {
-      this->chunk.print_constants(this->config);
+      this->program->print_constants(this->config);
     }
-    while (this->ip < this->chunk.end()) {
-      if constexpr (DISASSEMBLE_INSTRUCTIONS) {
-        if constexpr (PRINT_STACK) {
-          this->chunk.print_stack(this->config);
-        }
-        this->disassemble_instruction(*this->ip, this->ip - this->chunk.begin());
+    FlushGuard flush_guard(this->config);
+    ExecutingGuard executing_guard(this->executing);
+
+    switch (this->config.dispatch()) {
+      case Dispatch::CACHED_TOP: {
+        return this->dispatch<Dispatch::CACHED_TOP>();
+      }
+      case Dispatch::TAIL_CALL: {
+        return this->dispatch<Dispatch::TAIL_CALL>();
       }
+      default: {
+        return this->dispatch<Dispatch::PLAIN>();
+      }
+    }
+  }
 
-      switch (this->ip->major_opcode) {
-        case OpCode::NO_OP:
-          break;
-        case OpCode::CONSTANT: {
-          this->chunk.push_stack(this->chunk.constant_at(this->ip->modifying_bits));
-        } break;
-        case OpCode::NIL: {
-          this->chunk.push_stack(Value());
-        } break;
-        case OpCode::TRUE: {
-          this->chunk.push_stack(Value(true));
-        } break;
-        case OpCode::FALSE: {
-          this->chunk.push_stack(Value(false));
-        } break;
-        case OpCode::POP: {
-          this->chunk.pop_stack();
-        } break;
-        case OpCode::POP_N: {
-          this->chunk.pop_stack_n(this->ip->modifying_bits);
-        } break;
-        case OpCode::LOOKUP_LOCAL: {
-          this->chunk.push_stack(this->chunk.index_stack(this->sp + this->ip->modifying_bits));
-        } break;
-        case OpCode::ASSIGN_LOCAL: {
-          this->chunk.index_stack_mut(this->sp + this->ip->modifying_bits) = this->chunk.peek_stack();
-        } break;
-        case OpCode::LOOKUP_GLOBAL: {
-          Value name_value = this->chunk.constant_at(this->ip->modifying_bits);
-          if (!name_value.is_type(Value::Type::String)) {
-            RuntimeError::throw_err("invalid type for variable name");
-          }
-          Value::StringType name = name_value.string();
-          auto var               = this->chunk.find_global(name);
-          if (!this->chunk.is_global_found(var)) {
-            RuntimeError::throw_err("variable '", name, "' is undefined");
-          }
-          this->chunk.push_stack(var->second);
-        } break;
-        case OpCode::DEFINE_GLOBAL: {
-          Value name_value = this->chunk.constant_at(this->ip->modifying_bits);
-          if (!name_value.is_type(Value::Type::String)) {
-            RuntimeError::throw_err("invalid type for variable name");
-          }
-          Value::StringType name = name_value.string();
-          auto var               = this->chunk.find_global(name);
-          if (this->chunk.is_global_found(var)) {
-            RuntimeError::throw_err("variable '", name, "' is already defined");
-          }
-          this->chunk.set_global(std::move(name), this->chunk.pop_stack());
-        } break;
-        case OpCode::ASSIGN_GLOBAL: {
-          Value name_value = this->chunk.constant_at(this->ip->modifying_bits);
-          if (!name_value.is_type(Value::Type::String)) {
-            RuntimeError::throw_err("invalid type for variable name");
+  template <Dispatch D>
+  auto VM::dispatch() -> Value
+  {
+    // the hot state is kept in locals so it can live in registers, and is only synced back to the vm before something else
+    // may look at it: calls out to natives, errors, and the end of the script
+    auto running           = this->program;
+    const Program& program = *running;
+    const Value* constants = program.constant_data();
+    auto code              = program.begin();
+    auto end               = program.end();
+    auto ip                = this->ip;
+    Value* base            = this->context.stack_base();
+    Value* top             = this->context.stack_top();
+    Value* limit           = this->context.stack_limit();
+    Value* frame           = base + this->sp;
+    bool profile_functions = this->config.profile().functions;
+
+    auto sync = [&] {
+      this->ip = ip;
+      this->sp = frame - base;
+      this->context.set_stack_top(top);
+    };
+
+    // anything given the synced state may have moved the stack
+    auto reload = [&] {
+      base  = this->context.stack_base();
+      top   = this->context.stack_top();
+      limit = this->context.stack_limit();
+      frame = base + this->sp;
+    };
+
+    // every frame made room for all it pushes when it was entered
+    auto push = [&](Value v) { std::construct_at(top++, std::move(v)); };
+
+    auto pop = [&]() -> Value {
+      Value v = std::move(*--top);
+      std::destroy_at(top);
+      return v;
+    };
+
+    auto pop_n = [&](std::size_t n) {
+      top -= n;
+      std::destroy_n(top, n);
+    };
+
+    auto peek = [&](std::size_t index = 0) -> Value& { return top[-1 - static_cast<std::ptrdiff_t>(index)]; };
+
+    // with a cached top the number is the logical top of the stack, one past what is in memory
+    bool cached                  = false;
+    Value::NumberType cached_top = 0;
+
+    auto spill = [&] {
+      if (cached) {
+        cached = false;
+        push(Value(cached_top));
+      }
+    };
+
+    // a number cached with a number beneath it, the common case for arithmetic
+    auto cached_operands = [&]() -> bool { return cached && peek().is_type(Value::Type::Number); };
+
+    try {
+      while (ip < end) {
+        if constexpr (D == Dispatch::CACHED_TOP) {
+          // everything else expects the whole stack in memory
+          if (cached && !reads_cached_top(ip->major_opcode)) {
+            spill();
           }
-          Value::StringType name = name_value.string();
-          auto var               = this->chunk.find_global(std::move(name));
-          if (!this->chunk.is_global_found(var)) {
-            RuntimeError::throw_err("variable '", name, "' is undefined");
+        }
+
+        if constexpr (PROFILE_OPCODES) {
+          this->opcode_profiler.enter(ip - code, ip->major_opcode);
+        }
+
+        if constexpr (DISASSEMBLE_INSTRUCTIONS) {
+          sync();
+          if constexpr (PRINT_STACK) {
+            this->context.print_stack(this->config);
           }
-          var->second = this->chunk.peek_stack();
-        } break;
-        case OpCode::EQUAL: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a == b);
-        } break;
-        case OpCode::NOT_EQUAL: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a != b);
-        } break;
-        case OpCode::GREATER: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a > b);
-        } break;
-        case OpCode::GREATER_EQUAL: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a >= b);
-        } break;
-        case OpCode::LESS: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a < b);
-        } break;
-        case OpCode::LESS_EQUAL: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a <= b);
-        } break;
-        case OpCode::CHECK: {
-          Value v = this->chunk.pop_stack();
-          this->chunk.push_stack(this->chunk.peek_stack() == v);
-        } break;
-        case OpCode::ADD: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a + b);
-        } break;
-        case OpCode::SUB: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a - b);
-        } break;
-        case OpCode::MUL: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a * b);
-        } break;
-        case OpCode::DIV: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a / b);
-        } break;
-        case OpCode::MOD: {
-          Value b = this->chunk.pop_stack();
-          Value a = this->chunk.pop_stack();
-          this->chunk.push_stack(a % b);
-        } break;
-        case OpCode::NOT: {
-          this->chunk.push_stack(!this->chunk.pop_stack());
-        } break;
-        case OpCode::NEGATE: {
-          this->chunk.push_stack(-this->chunk.pop_stack());
-        } break;
-        case OpCode::PRINT: {
-          config.write_line(this->chunk.pop_stack());
-        } break;
-        case OpCode::SWAP: {
-          Value a = this->chunk.pop_stack();
-          Value b = this->chunk.pop_stack();
-          this->chunk.push_stack(a);
-          this->chunk.push_stack(b);
-        } break;
-        case OpCode::MOVE: {
-          Value top = this->chunk.peek_stack();
-          // shift the value down, useful for returning
-          this->chunk.index_stack_mut(this->chunk.stack_size() - 1 - this->ip->modifying_bits) = top;
-        } break;
-        case OpCode::JUMP: {
-          this->ip += this->ip->modifying_bits;
-          continue;
-        } break;
-        case OpCode::JUMP_IF_FALSE: {
-          if (!this->chunk.peek_stack().truthy()) {
-            this->ip += this->ip->modifying_bits;
+          this->disassemble_instruction(*ip, ip - code);
+        }
+
+        switch (ip->major_opcode) {
+          case OpCode::NO_OP:
+            break;
+          case OpCode::CONSTANT: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              spill();
+              const Value& constant = constants[ip->modifying_bits];
+              if (constant.is_type(Value::Type::Number)) {
+                cached_top = constant.number();
+                cached     = true;
+                break;
+              }
+            }
+            push(constants[ip->modifying_bits]);
+          } break;
+          case OpCode::NIL: {
+            push(Value());
+          } break;
+          case OpCode::TRUE: {
+            push(Value(true));
+          } break;
+          case OpCode::FALSE: {
+            push(Value(false));
+          } break;
+          case OpCode::POP: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached) {
+                cached = false;
+                break;
+              }
+            }
+            pop();
+          } break;
+          case OpCode::POP_N: {
+            pop_n(ip->modifying_bits);
+          } break;
+          case OpCode::LOOKUP_LOCAL: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              // the local may be the cached value itself
+              spill();
+              const Value& local = frame[ip->modifying_bits];
+              if (local.is_type(Value::Type::Number)) {
+                cached_top = local.number();
+                cached     = true;
+                break;
+              }
+            }
+            push(frame[ip->modifying_bits]);
+          } break;
+          case OpCode::ASSIGN_LOCAL: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached) {
+                frame[ip->modifying_bits] = cached_top;
+                break;
+              }
+            }
+            frame[ip->modifying_bits] = peek();
+          } break;
+          case OpCode::LOOKUP_GLOBAL: {
+            // verified to be a string when compiled
+            Value::StringType name = constants[ip->modifying_bits].string_ref();
+            auto var               = this->context.find_global(name);
+            if (!this->context.is_global_found(var)) {
+              RuntimeError::throw_err("variable '", name, "' is undefined");
+            }
+            push(var->second);
+          } break;
+          case OpCode::DEFINE_GLOBAL: {
+            // verified to be a string when compiled
+            Value::StringType name = constants[ip->modifying_bits].string_ref();
+            auto var               = this->context.find_global(name);
+            if (this->context.is_global_found(var)) {
+              RuntimeError::throw_err("variable '", name, "' is already defined");
+            }
+            this->context.set_global(std::move(name), pop());
+          } break;
+          case OpCode::ASSIGN_GLOBAL: {
+            // verified to be a string when compiled
+            Value::StringType name = constants[ip->modifying_bits].string_ref();
+            auto var               = this->context.find_global(std::move(name));
+            if (!this->context.is_global_found(var)) {
+              RuntimeError::throw_err("variable '", name, "' is undefined");
+            }
+            var->second = peek();
+          } break;
+          case OpCode::ADD_ASSIGN_LOCAL: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached) {
+                auto& local = frame[add_assign_index(ip->modifying_bits)];
+                if (local.is_type(Value::Type::Number)) {
+                  local  = local.number() + cached_top;
+                  cached = add_assign_pushes(ip->modifying_bits);
+                  if (cached) {
+                    cached_top = local.number();
+                  }
+                  break;
+                }
+                spill();
+              }
+            }
+            Value b     = pop();
+            auto& local = frame[add_assign_index(ip->modifying_bits)];
+            local += b;
+            if (add_assign_pushes(ip->modifying_bits)) {
+              push(local);
+            }
+          } break;
+          case OpCode::ADD_ASSIGN_GLOBAL: {
+            // verified to be a string when compiled
+            Value::StringType name = constants[add_assign_index(ip->modifying_bits)].string_ref();
+            auto var               = this->context.find_global(name);
+            if (!this->context.is_global_found(var)) {
+              RuntimeError::throw_err("variable '", name, "' is undefined");
+            }
+            var->second += pop();
+            if (add_assign_pushes(ip->modifying_bits)) {
+              push(var->second);
+            }
+          } break;
+          case OpCode::EQUAL: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                peek() = peek().number() == cached_top;
+                cached = false;
+                break;
+              }
+              spill();
+            }
+            Value b = pop();
+            Value a = pop();
+            push(a == b);
+          } break;
+          case OpCode::NOT_EQUAL: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                peek() = peek().number() != cached_top;
+                cached = false;
+                break;
+              }
+              spill();
+            }
+            Value b = pop();
+            Value a = pop();
+            push(a != b);
+          } break;
+          case OpCode::GREATER: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                peek() = peek().number() > cached_top;
+                cached = false;
+                break;
+              }
+              spill();
+            }
+            Value b = pop();
+            Value a = pop();
+            push(a > b);
+          } break;
+          case OpCode::GREATER_EQUAL: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                peek() = peek().number() >= cached_top;
+                cached = false;
+                break;
+              }
+              spill();
+            }
+            Value b = pop();
+            Value a = pop();
+            push(a >= b);
+          } break;
+          case OpCode::LESS: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                peek() = peek().number() < cached_top;
+                cached = false;
+                break;
+              }
+              spill();
+            }
+            Value b = pop();
+            Value a = pop();
+            push(a < b);
+          } break;
+          case OpCode::LESS_EQUAL: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                peek() = peek().number() <= cached_top;
+                cached = false;
+                break;
+              }
+              spill();
+            }
+            Value b = pop();
+            Value a = pop();
+            push(a <= b);
+          } break;
+          case OpCode::CHECK: {
+            Value v = pop();
+            push(peek() == v);
+          } break;
+          case OpCode::ADD: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                cached_top = peek().number() + cached_top;
+                pop_n(1);
+                break;
+              }
+              spill();
+            }
+            // promoting the nursery's survivors searches the stack
+            sync();
+            auto resource = this->context.string_resource();
+            Value b       = pop();
+            Value a       = pop();
+            push(a.add(b, resource));
+          } break;
+          case OpCode::SUB: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                cached_top = peek().number() - cached_top;
+                pop_n(1);
+                break;
+              }
+              spill();
+            }
+            Value b = pop();
+            Value a = pop();
+            push(a - b);
+          } break;
+          case OpCode::MUL: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                cached_top = peek().number() * cached_top;
+                pop_n(1);
+                break;
+              }
+              spill();
+            }
+            Value b = pop();
+            Value a = pop();
+            push(a * b);
+          } break;
+          case OpCode::DIV: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                cached_top = peek().number() / cached_top;
+                pop_n(1);
+                break;
+              }
+              spill();
+            }
+            Value b = pop();
+            Value a = pop();
+            push(a / b);
+          } break;
+          case OpCode::MOD: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached_operands()) {
+                cached_top = std::fmod(peek().number(), cached_top);
+                pop_n(1);
+                break;
+              }
+              spill();
+            }
+            Value b = pop();
+            Value a = pop();
+            push(a % b);
+          } break;
+          case OpCode::NOT: {
+            push(!pop());
+          } break;
+          case OpCode::NEGATE: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              if (cached) {
+                cached_top = -cached_top;
+                break;
+              }
+            }
+            push(-pop());
+          } break;
+          case OpCode::PRINT: {
+            this->config.print_line(pop().to_string());
+          } break;
+          case OpCode::SWAP: {
+            Value a = pop();
+            Value b = pop();
+            push(a);
+            push(b);
+          } break;
+          case OpCode::MOVE: {
+            // shift the value down, useful for returning
+            *(top - 1 - ip->modifying_bits) = peek();
+          } break;
+          case OpCode::JUMP: {
+            ip += ip->modifying_bits;
             continue;
-          }
-        } break;
-        case OpCode::LOOP: {
-          this->ip -= this->ip->modifying_bits;
-          continue;
-        } break;
-        case OpCode::OR: {
-          Value v = this->chunk.peek_stack();
-          if (v.truthy()) {
-            this->ip += this->ip->modifying_bits;
+          } break;
+          case OpCode::JUMP_IF_FALSE: {
+            if constexpr (D == Dispatch::CACHED_TOP) {
+              // numbers are always truthy
+              if (cached) {
+                break;
+              }
+            }
+            if (!peek().truthy()) {
+              ip += ip->modifying_bits;
+              continue;
+            }
+          } break;
+          case OpCode::LOOP: {
+            ip -= ip->modifying_bits;
             continue;
-          } else {
-            this->chunk.pop_stack();
-          }
-        } break;
-        case OpCode::AND: {
-          Value v = this->chunk.peek_stack();
-          if (!v.truthy()) {
-            this->ip += this->ip->modifying_bits;
+          } break;
+          case OpCode::FOR_PREP: {
+            auto comparison = for_loop_comparison(ip->modifying_bits);
+            if (!for_loop_continues(comparison, peek(2), peek(1))) {
+              ip += for_loop_offset(ip->modifying_bits);
+              continue;
+            }
+          } break;
+          case OpCode::FOR_LOOP: {
+            auto comparison = for_loop_comparison(ip->modifying_bits);
+            bool ascending  = comparison == ForComparison::LESS || comparison == ForComparison::LESS_EQUAL;
+            Value& counter  = top[-3];
+            Value limit     = peek(1);
+            Value step      = peek();
+
+            bool again;
+            if (counter.is_type(Value::Type::Number) && limit.is_type(Value::Type::Number)) {
+              Value::NumberType next = ascending ? counter.number() + step.number() : counter.number() - step.number();
+              counter                = next;
+              again                  = for_loop_continues(comparison, next, limit.number());
+            } else {
+              // the body assigned something other than a number to the counter, behave as the unfused loop would
+              counter = ascending ? counter + step : counter - step;
+              again   = for_loop_continues(comparison, counter, limit);
+            }
+
+            if (again) {
+              ip -= for_loop_offset(ip->modifying_bits);
+              continue;
+            }
+          } break;
+          case OpCode::MATCH_TABLE: {
+            ip += program.jump_table_at(ip->modifying_bits).offset_for(peek());
             continue;
-          } else {
-            this->chunk.pop_stack();
-          }
-        } break;
-        case OpCode::PUSH_SP: {
-          this->chunk.push_stack(Value{Value::AddressType{this->sp}});
-          // - 1 for the fn on the stack, - 1 because size()
-          this->sp = this->chunk.stack_size() - this->ip->modifying_bits - 1 - 1;
-        } break;
-        case OpCode::CALL: {
-          auto fn_val = this->chunk.peek_stack(this->ip->modifying_bits + 2);
-          switch (fn_val.type()) {
-            case Value::Type::Function: {
-              auto fn = fn_val.function();
-              if (this->ip->modifying_bits != fn->airity) {
-                RuntimeError::throw_err(
-                 "tried calling function with incorrect number of args, expected ",
-                 fn->airity,
-                 ", got ",
-                 this->ip->modifying_bits);
-              }
-              this->ip = this->chunk.index_code_mut(fn->instruction_ptr);
-            } break;
-            case Value::Type::Native: {
-              auto fn = fn_val.native();
-              if (this->ip->modifying_bits != fn->airity) {
-                RuntimeError::throw_err(
-                 "tried calling function with incorrect number of args, expected ",
-                 fn->airity,
-                 ", got ",
-                 this->ip->modifying_bits);
+          } break;
+          case OpCode::OR: {
+            Value v = peek();
+            if (v.truthy()) {
+              ip += ip->modifying_bits;
+              continue;
+            } else {
+              pop();
+            }
+          } break;
+          case OpCode::AND: {
+            Value v = peek();
+            if (!v.truthy()) {
+              ip += ip->modifying_bits;
+              continue;
+            } else {
+              pop();
+            }
+          } break;
+          case OpCode::PUSH_SP: {
+            push(Value{Value::AddressType{static_cast<std::size_t>(frame - base)}});
+            // - 1 for the fn on the stack, - 1 for the pushed stack pointer
+            frame = top - ip->modifying_bits - 1 - 1;
+          } break;
+          case OpCode::CALL: {
+            auto fn_val = peek(ip->modifying_bits + 2);
+            switch (fn_val.type()) {
+              case Value::Type::Function: {
+                auto fn = fn_val.function();
+                if (ip->modifying_bits != fn->airity) {
+                  RuntimeError::throw_err(
+                   "tried calling function with incorrect number of args, expected ",
+                   fn->airity,
+                   ", got ",
+                   ip->modifying_bits);
+                }
+                if (static_cast<std::size_t>(limit - top) < fn->max_stack) {
+                  sync();
+                  this->context.reserve_stack(fn->max_stack);
+                  reload();
+                }
+                if (profile_functions) [[unlikely]] {
+                  this->function_profiler.enter(fn->name);
+                }
+                ip = code + fn->instruction_ptr;
+              } break;
+              case Value::Type::Native: {
+                auto fn = fn_val.native();
+                if (ip->modifying_bits != fn->airity) {
+                  RuntimeError::throw_err(
+                   "tried calling function with incorrect number of args, expected ",
+                   fn->airity,
+                   ", got ",
+                   ip->modifying_bits);
+                }
+                std::vector<Value> args;
+                // remove the return address & restore the stack pointer the call saved
+                pop();
+                frame = base + pop().address().ptr;
+                // push arguments into vector, copied so nothing native code keeps can point into the nursery
+                for (std::size_t i = 0; i < fn->airity; i++) { args.push_back(peek(i)); }
+                if (profile_functions) [[unlikely]] {
+                  this->function_profiler.enter(fn->name);
+                }
+                // the native may call back into the vm or collect garbage, so the arguments & function stay on the stack
+                // to keep them reachable until it returns
+                sync();
+                auto retval = fn->call(std::move(args));
+                reload();
+                pop_n(fn->airity + 1);
+                push(std::move(retval));
+                if (profile_functions) [[unlikely]] {
+                  this->function_profiler.leave();
+                }
+              } break;
+              default: {
+                RuntimeError::throw_err("tried calling non-function: ", fn_val);
               }
-              std::vector<Value> args;
-              // remove the stack pointer & return address
-              this->chunk.pop_stack_n(2);
-              // push arguments into vector
-              for (std::size_t i = 0; i < fn->airity; i++) { args.push_back(std::move(this->chunk.pop_stack())); }
-              // remove the function
-              this->chunk.pop_stack();
-              this->chunk.push_stack(fn->call(std::move(args)));
-            } break;
-            default: {
-              RuntimeError::throw_err("tried calling non-function: ", fn_val);
             }
-          }
-        } break;
-        case OpCode::RETURN: {
-          auto local_count = this->ip->modifying_bits;
-          auto retval      = this->chunk.pop_stack();
-
-          // get the return address
-          auto v = this->chunk.pop_stack();
-          if (!v.is_type(Value::Type::Address)) {
-            RuntimeError::throw_err("trying to return to an invalid value: ", v);
-          }
-          this->ip = this->chunk.index_code_mut(v.address().ptr);
+          } break;
+          case OpCode::RETURN: {
+            auto local_count = ip->modifying_bits;
+            auto retval      = pop();
 
-          // restore the stack pointer
-          v        = this->chunk.pop_stack();
-          this->sp = v.address().ptr;
-          if (!v.is_type(Value::Type::Address)) {
-            RuntimeError::throw_err("trying to set the stack pointer to an invalid value: ", v);
-          }
+            // the return address & stack pointer, verified to be where the call left them
+            ip    = code + pop().address().ptr;
+            frame = base + pop().address().ptr;
 
-          // remove the locals & function
-          this->chunk.pop_stack_n(local_count + 1);
-          this->chunk.push_stack(retval);
-          continue;
-        } break;
-        case OpCode::END: {
-          if constexpr (PRINT_STACK) {
-            this->chunk.print_stack(this->config);
-          }
-          Value retval;
-          if (!this->chunk.stack_empty()) {
-            retval = this->chunk.pop_stack();
+            // remove the locals & function
+            pop_n(local_count + 1);
+            push(retval);
+
+            if (profile_functions) [[unlikely]] {
+              this->function_profiler.leave();
+            }
+            continue;
+          } break;
+          case OpCode::END: {
+            sync();
+            return this->finish();
+          } break;
+          default: {
+            RuntimeError::throw_err("invalid op code: ", static_cast<std::size_t>(ip->major_opcode));
           }
-          return retval;
-        } break;
-        default: {
-          RuntimeError::throw_err("invalid op code: ", static_cast<std::size_t>(this->ip->major_opcode));
         }
+        ip++;
       }
-      this->ip++;
+    } catch (...) {
+      spill();
+      sync();
+      throw;
     }
 
     // never gets here
     return Value();
   }
 
-  void VM::disassemble_chunk() noexcept
+  auto VM::finish() -> Value
+  {
+    if constexpr (PRINT_STACK) {
+      this->context.print_stack(this->config);
+    }
+    Value retval;
+    if (!this->context.stack_empty()) {
+      retval = this->context.pop_stack();
+      // the host may keep it past the next nursery collection
+      this->context.promote(retval);
+    }
+    return retval;
+  }
+
+  void VM::start_profile()
+  {
+    if constexpr (PROFILE_OPCODES) {
+      this->opcode_profiler.reset();
+    }
+    this->function_profiler.reset();
+    if (this->config.profile().functions) {
+      this->function_profiler.enter("script");
+    }
+  }
+
+  void VM::finish_profile()
+  {
+    if constexpr (PROFILE_OPCODES) {
+      this->opcode_profiler.stop();
+      this->opcode_profiler.report(*this->program, this->config);
+    }
+
+    const auto& profile = this->config.profile();
+    if (!profile.functions) {
+      return;
+    }
+
+    this->function_profiler.stop();
+    if (profile.report) {
+      this->function_profiler.report(this->config);
+    }
+    if (profile.folded != nullptr) {
+      this->function_profiler.write_folded(*profile.folded);
+    } else if (!profile.folded_path.empty()) {
+      std::ofstream folded(profile.folded_path);
+      this->function_profiler.write_folded(folded);
+    }
+  }
+
+  auto VM::opcode_profile() const noexcept -> const OpcodeProfiler&
+  {
+    return this->opcode_profiler;
+  }
+
+  auto VM::function_profile() const noexcept -> const FunctionProfiler&
+  {
+    return this->function_profiler;
+  }
+
+  void VM::disassemble_program() noexcept
   {
     this->config.write_line("<< ", "MAIN", " >>");
     std::size_t offset = 0;
-    for (const auto& i : chunk) { this->disassemble_instruction(i, offset++); }
+    for (const auto& i : *this->program) { this->disassemble_instruction(i, offset++); }
     this->config.write_line("<< ", "END", " >>");
   }
 
@@ -385,10 +958,11 @@ namespace ss
     this->config.write("0x", std::hex, std::setw(4), std::setfill('0'), offset, ' ');
     this->config.reset_ostream();
 
-    if (offset > 0 && this->chunk.line_at(offset) == this->chunk.line_at(offset - 1)) {
+    auto location = this->program->location_at(offset);
+    if (offset > 0 && location.line == this->program->line_at(offset - 1)) {
       this->config.write("   | ");
     } else {
-      this->config.write(std::setw(4), std::setfill('0'), this->chunk.line_at(offset), ' ');
+      this->config.write(std::setw(4), std::setfill('0'), location.line, ' ');
     }
 
     this->config.reset_ostream();
@@ -396,7 +970,7 @@ namespace ss
     switch (i.major_opcode) {
       SS_SIMPLE_PRINT_CASE(NO_OP)
       SS_COMPLEX_PRINT_CASE(CONSTANT, {
-        Value constant = this->chunk.constant_at(i.modifying_bits);
+        Value constant = this->program->constant_at(i.modifying_bits);
         this->config.write(std::setw(16), std::left, i.major_opcode);
         this->config.reset_ostream();
         this->config.write(' ', std::setw(4), i.modifying_bits);
@@ -431,7 +1005,7 @@ namespace ss
         this->config.reset_ostream();
       })
       SS_COMPLEX_PRINT_CASE(LOOKUP_GLOBAL, {
-        Value constant = this->chunk.constant_at(i.modifying_bits);
+        Value constant = this->program->constant_at(i.modifying_bits);
         this->config.write(std::setw(16), std::left, i.major_opcode);
         this->config.reset_ostream();
         this->config.write(' ', std::setw(4), i.modifying_bits);
@@ -440,7 +1014,7 @@ namespace ss
         this->config.reset_ostream();
       })
       SS_COMPLEX_PRINT_CASE(DEFINE_GLOBAL, {
-        Value constant = this->chunk.constant_at(i.modifying_bits);
+        Value constant = this->program->constant_at(i.modifying_bits);
         this->config.write(std::setw(16), std::left, i.major_opcode);
         this->config.reset_ostream();
         this->config.write(' ', std::setw(4), i.modifying_bits);
@@ -449,7 +1023,7 @@ namespace ss
         this->config.reset_ostream();
       })
       SS_COMPLEX_PRINT_CASE(ASSIGN_GLOBAL, {
-        Value constant = this->chunk.constant_at(i.modifying_bits);
+        Value constant = this->program->constant_at(i.modifying_bits);
         this->config.write(std::setw(16), std::left, i.major_opcode);
         this->config.reset_ostream();
         this->config.write(' ', std::setw(4), i.modifying_bits);
@@ -497,6 +1071,43 @@ namespace ss
         this->config.write_line(' ', std::setw(4), i.modifying_bits);
         this->config.reset_ostream();
       })
+      SS_COMPLEX_PRINT_CASE(ADD_ASSIGN_LOCAL, {
+        this->config.write(std::setw(16), std::left, i.major_opcode);
+        this->config.reset_ostream();
+        this->config.write(' ', std::setw(4), add_assign_index(i.modifying_bits));
+        this->config.reset_ostream();
+        this->config.write_line(" ", this->sp + add_assign_index(i.modifying_bits), ' ', add_assign_pushes(i.modifying_bits));
+        this->config.reset_ostream();
+      })
+      SS_COMPLEX_PRINT_CASE(ADD_ASSIGN_GLOBAL, {
+        Value constant = this->program->constant_at(add_assign_index(i.modifying_bits));
+        this->config.write(std::setw(16), std::left, i.major_opcode);
+        this->config.reset_ostream();
+        this->config.write(' ', std::setw(4), add_assign_index(i.modifying_bits));
+        this->config.reset_ostream();
+        this->config.write_line(" '", constant.to_string(), "' ", add_assign_pushes(i.modifying_bits));
+        this->config.reset_ostream();
+      })
+      SS_COMPLEX_PRINT_CASE(FOR_PREP, {
+        this->config.write(std::setw(16), std::left, i.major_opcode);
+        this->config.reset_ostream();
+        this->config.write_line(
+         ' ', std::setw(4), for_loop_offset(i.modifying_bits), ' ', static_cast<int>(for_loop_comparison(i.modifying_bits)));
+        this->config.reset_ostream();
+      })
+      SS_COMPLEX_PRINT_CASE(FOR_LOOP, {
+        this->config.write(std::setw(16), std::left, i.major_opcode);
+        this->config.reset_ostream();
+        this->config.write_line(
+         ' ', std::setw(4), for_loop_offset(i.modifying_bits), ' ', static_cast<int>(for_loop_comparison(i.modifying_bits)));
+        this->config.reset_ostream();
+      })
+      SS_COMPLEX_PRINT_CASE(MATCH_TABLE, {
+        this->config.write(std::setw(16), std::left, i.major_opcode);
+        this->config.reset_ostream();
+        this->config.write_line(' ', std::setw(4), i.modifying_bits);
+        this->config.reset_ostream();
+      })
       SS_COMPLEX_PRINT_CASE(OR, {
         this->config.write(std::setw(16), std::left, i.major_opcode);
         this->config.reset_ostream();
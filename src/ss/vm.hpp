@@ -3,40 +3,161 @@
 #include "cfg.hpp"
 #include "code.hpp"
 #include "datatypes.hpp"
+#include "profiler.hpp"
 
 #include <cinttypes>
 #include <filesystem>
+#include <memory>
+#include <string_view>
 #include <unordered_map>
 
 namespace ss
 {
+  /**
+   * @brief Where compiled code starts, runnable any number of times until a run_script or run_file starts the vm over
+   */
+  struct CompiledScript
+  {
+    std::size_t entry;
+    /**
+     * @brief The most values the top level of the script pushes, made room for before it runs
+     */
+    std::size_t max_stack;
+  };
+
+  struct TailCallEngine;
+
   class VM
   {
    public:
-    VM(VMConfig cfg = VMConfig::basic);
+    VM(VMConfig cfg = VMConfig::basic, HeapConfig heap_config = HeapConfig());
     ~VM() = default;
 
     auto repl(VMConfig cfg = VMConfig::basic) -> int;
 
+    /**
+     * @brief Compiles & runs the file, discarding all previously compiled code. Globals remain
+     */
     auto run_file(std::string filename) -> Value;
+
+    /**
+     * @brief Compiles & runs the script, discarding all previously compiled code. Globals remain
+     */
     auto run_script(std::string src, std::filesystem::path path = std::filesystem::current_path()) -> Value;
 
-    void set_var(Value::StringType name, Value value) noexcept;
-    auto get_var(Value::StringType name) noexcept -> Value;
+    /**
+     * @brief Compiles the script after the code already in the vm, leaving the earlier code and the functions it defined
+     * intact
+     */
+    auto compile(std::string src, std::filesystem::path path = std::filesystem::current_path()) -> CompiledScript;
+
+    /**
+     * @brief Runs compiled code from the start, such as to define the functions in it. Unless it is run from within a
+     * native function, this starts a new profile and writes it out once the run ends
+     */
+    auto run(CompiledScript script) -> Value;
+
+    /**
+     * @brief Calls a script or native function directly, without compiling anything. Safe to use from within a native
+     * function
+     */
+    auto call(Value fn, NativeFunction::Args args) -> Value;
+
+    template <typename... Args>
+    auto call(Value fn, Args&&... args) -> Value
+    {
+      return this->call(fn, NativeFunction::Args{Value(std::forward<Args>(args))...});
+    }
+
+    /**
+     * @brief Creates an object on the script heap, such as a native function. It is freed by a later collection unless it
+     * has been made reachable from the script, e.g. with set_var, before the next object is created
+     */
+    template <std::derived_from<Object> T, typename... Args>
+    auto make(Args&&... args) -> T*
+    {
+      return this->context.make<T>(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Frees every heap object the script can no longer reach
+     */
+    void collect_garbage();
+
+    auto heap_stats() const noexcept -> const HeapStats&;
+
+    void set_var(std::string_view name, Value value) noexcept;
+    auto get_var(std::string_view name) noexcept -> Value;
 
     void test();
 
+    /**
+     * @brief What the last script executed spent its time on. Only recorded when PROFILE_OPCODES is enabled
+     */
+    auto opcode_profile() const noexcept -> const OpcodeProfiler&;
+
+    /**
+     * @brief Where the last run spent its time per function, plus any calls the host made since. Only recorded when the
+     * config's profile asks for functions, and can be written out at any time with write_folded
+     */
+    auto function_profile() const noexcept -> const FunctionProfiler&;
+
    private:
+    friend class VMPool;
+    friend struct TailCallEngine;
+
     VMConfig config;
-    BytecodeChunk chunk;
-    BytecodeChunk::InstructionIterator ip;
+    /**
+     * @brief Never modified while anything else holds it, compiling more code copies it first so other vms sharing it or a
+     * running loop are unaffected
+     */
+    std::shared_ptr<const Program> program;
+    ExecutionContext context;
+    Program::InstructionIterator ip;
     std::size_t sp;
+    /**
+     * @brief How many executions are in progress, more than one while a native function calls back into the vm
+     */
+    std::size_t executing;
+    OpcodeProfiler opcode_profiler;
+    FunctionProfiler function_profiler;
 
     void run_line(std::string line);
-    void compile(std::string filename, std::string&& src);
     auto execute() -> Value;
 
-    void disassemble_chunk() noexcept;
+    /**
+     * @brief The interpreter loop, specialized for the dispatch the config selects
+     */
+    template <Dispatch D>
+    auto dispatch() -> Value;
+
+    /**
+     * @brief Hands back what the script left on the stack once it reaches its END
+     */
+    auto finish() -> Value;
+
+    /**
+     * @brief Discards the last run's profile and starts timing the new run
+     */
+    void start_profile();
+
+    /**
+     * @brief Stops timing the run, reporting and writing out the profile as the config says
+     */
+    void finish_profile();
+
+    /**
+     * @brief Where a function called from the host returns to, an END that hands its return value back
+     */
+    auto host_return_address() -> std::size_t;
+
+    void disassemble_program() noexcept;
     void disassemble_instruction(Instruction i, std::size_t offset) noexcept;
   };
+
+  /**
+   * @brief Defined with its handlers in handlers.cpp
+   */
+  template <>
+  auto VM::dispatch<Dispatch::TAIL_CALL>() -> Value;
 }  // namespace ss
\ No newline at end of file
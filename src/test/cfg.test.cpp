@@ -1,8 +1,15 @@
 #include "helpers.hpp"
 #include "ss/cfg.hpp"
+#include "ss/exceptions.hpp"
+#include "ss/vm.hpp"
 #include <gtest/gtest.h>
 #include <sstream>
+#include <unistd.h>
 
+using ss::FlushPolicy;
+using ss::OutputConfig;
+using ss::RuntimeError;
+using ss::VM;
 using ss::VMConfig;
 
 class TestVMConfig: public testing::Test
@@ -71,3 +78,60 @@ TEST_F(TestVMConfig, METHOD(reset_ostream, can_set_ostream_back_to_inital_state)
 
   EXPECT_EQ(this->oss->str(), "1.23 7.65 5.4321");
 }
+
+TEST_F(TestVMConfig, METHOD(print_line, flushes_every_line_by_default))
+{
+  this->config->print_line("first");
+  EXPECT_EQ(this->oss->str(), "first\n");
+  this->config->print_line("second");
+  EXPECT_EQ(this->oss->str(), "first\nsecond\n");
+}
+
+TEST_F(TestVMConfig, METHOD(print_line, flushes_when_full))
+{
+  VMConfig config(this->iss.get(), this->oss.get(), OutputConfig{.buffer_size = 8, .flush = FlushPolicy::FULL});
+
+  config.print_line("abc");
+  EXPECT_EQ(this->oss->str(), "");
+  config.print_line("defg");
+  EXPECT_EQ(this->oss->str(), "abc\ndefg\n");
+}
+
+TEST_F(TestVMConfig, METHOD(print_line, waits_for_an_explicit_flush_on_exit))
+{
+  VMConfig config(this->iss.get(), this->oss.get(), OutputConfig{.buffer_size = 1, .flush = FlushPolicy::EXIT});
+
+  config.print_line("abc");
+  config.print_line("def");
+  EXPECT_EQ(this->oss->str(), "");
+
+  // anything written directly comes after what was printed
+  config.write("ghi");
+  EXPECT_EQ(this->oss->str(), "abc\ndef\nghi");
+}
+
+TEST_F(TestVMConfig, METHOD(flush, writes_to_a_file_descriptor))
+{
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+
+  VMConfig config(this->iss.get(), this->oss.get(), OutputConfig{.flush = FlushPolicy::EXIT, .fd = fds[1]});
+  config.print_line("through the pipe");
+  config.flush();
+  close(fds[1]);
+
+  char buffer[64];
+  auto bytes = read(fds[0], buffer, sizeof(buffer));
+  close(fds[0]);
+
+  EXPECT_EQ(std::string(buffer, bytes), "through the pipe\n");
+  EXPECT_EQ(this->oss->str(), "");
+}
+
+TEST_F(TestVMConfig, METHOD(flush, happens_when_a_script_fails))
+{
+  VM vm(VMConfig(this->iss.get(), this->oss.get(), OutputConfig{.flush = FlushPolicy::EXIT}));
+
+  EXPECT_THROW(vm.run_script("print 1; print 2; print -nil;"), RuntimeError);
+  EXPECT_EQ(this->oss->str(), "1\n2\n");
+}
@@ -2,72 +2,87 @@
 
 #include "helpers.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <gtest/gtest.h>
+#include <memory_resource>
+#include <thread>
 
-using ss::BytecodeChunk;
+#define TEST_SCRIPT(src) #src
+
+using ss::ExecutionContext;
 using ss::Instruction;
+using ss::JumpTable;
 using ss::OpCode;
+using ss::Program;
 using ss::Value;
 
-class TestBytecodeChunk: public testing::Test
+class TestProgram: public testing::Test
+{
+ protected:
+  Program program;
+};
+
+class TestExecutionContext: public testing::Test
 {
  protected:
-  BytecodeChunk chunk;
+  ExecutionContext context;
 };
 
-TEST_F(TestBytecodeChunk, METHOD(write, writing_adds_the_correct_line))
+TEST_F(TestProgram, METHOD(write, writing_adds_the_correct_line))
 {
-  this->chunk.write(Instruction{OpCode::RETURN}, 1);
-  this->chunk.write(Instruction{OpCode::RETURN}, 1);
-  this->chunk.write(Instruction{OpCode::RETURN}, 2);
+  this->program.write(Instruction{OpCode::RETURN}, 1);
+  this->program.write(Instruction{OpCode::RETURN}, 1);
+  this->program.write(Instruction{OpCode::RETURN}, 2);
 
-  EXPECT_EQ(this->chunk.line_at(0), 1);
-  EXPECT_EQ(this->chunk.line_at(1), 1);
-  EXPECT_EQ(this->chunk.line_at(2), 2);
+  EXPECT_EQ(this->program.line_at(0), 1);
+  EXPECT_EQ(this->program.line_at(1), 1);
+  EXPECT_EQ(this->program.line_at(2), 2);
 }
 
-TEST_F(TestBytecodeChunk, METHOD(write_constant, can_write_constant))
+TEST_F(TestProgram, METHOD(write_constant, can_write_constant))
 {
-  this->chunk.write_constant(Value(), 1);
-  this->chunk.write_constant(Value(1.0), 1);
-  this->chunk.write_constant(Value("str"), 2);
+  this->program.write_constant(Value(), 1);
+  this->program.write_constant(Value(1.0), 1);
+  this->program.write_constant(Value("str"), 2);
 
-  EXPECT_EQ(this->chunk.line_at(0), 1);
-  EXPECT_EQ(this->chunk.line_at(1), 1);
-  EXPECT_EQ(this->chunk.line_at(2), 2);
+  EXPECT_EQ(this->program.line_at(0), 1);
+  EXPECT_EQ(this->program.line_at(1), 1);
+  EXPECT_EQ(this->program.line_at(2), 2);
 
-  EXPECT_EQ(this->chunk.constant_at(0), Value());
-  EXPECT_EQ(this->chunk.constant_at(1), Value(1.0));
-  EXPECT_EQ(this->chunk.constant_at(2), Value("str"));
+  EXPECT_EQ(this->program.constant_at(0), Value());
+  EXPECT_EQ(this->program.constant_at(1), Value(1.0));
+  EXPECT_EQ(this->program.constant_at(2), Value("str"));
 }
 
-TEST_F(TestBytecodeChunk, METHOD(push_stack__pop_stack, can_push_onto_stack_and_pop))
+TEST_F(TestExecutionContext, METHOD(push_stack__pop_stack, can_push_onto_stack_and_pop))
 {
-  EXPECT_TRUE(this->chunk.stack_empty());
+  EXPECT_TRUE(this->context.stack_empty());
 
-  this->chunk.push_stack(Value());
-  this->chunk.push_stack(Value(1.0));
-  this->chunk.push_stack(Value("str"));
+  this->context.push_stack(Value());
+  this->context.push_stack(Value(1.0));
+  this->context.push_stack(Value("str"));
 
-  EXPECT_FALSE(this->chunk.stack_empty());
+  EXPECT_FALSE(this->context.stack_empty());
 
-  EXPECT_EQ(this->chunk.pop_stack(), Value("str"));
-  EXPECT_EQ(this->chunk.pop_stack(), Value(1.0));
-  EXPECT_EQ(this->chunk.pop_stack(), Value());
+  EXPECT_EQ(this->context.pop_stack(), Value("str"));
+  EXPECT_EQ(this->context.pop_stack(), Value(1.0));
+  EXPECT_EQ(this->context.pop_stack(), Value());
 
-  EXPECT_TRUE(this->chunk.stack_empty());
+  EXPECT_TRUE(this->context.stack_empty());
 }
 
-TEST_F(TestBytecodeChunk, METHOD(pop_stack_n, removes_the_specified_range))
+TEST_F(TestExecutionContext, METHOD(pop_stack_n, removes_the_specified_range))
 {
-  for (int i = 0; i < 10; i++) { this->chunk.push_stack(Value(1.0 * i)); }
+  for (int i = 0; i < 10; i++) { this->context.push_stack(Value(1.0 * i)); }
 
-  EXPECT_EQ(this->chunk.stack_size(), 10);
+  EXPECT_EQ(this->context.stack_size(), 10);
 
-  this->chunk.pop_stack_n(5);
+  this->context.pop_stack_n(5);
 
-  EXPECT_EQ(this->chunk.stack_size(), 5);
-  for (int i = 4; i < 0; i--) { EXPECT_EQ(this->chunk.pop_stack(), Value(1.0 * i)); }
+  EXPECT_EQ(this->context.stack_size(), 5);
+  for (int i = 4; i < 0; i--) { EXPECT_EQ(this->context.pop_stack(), Value(1.0 * i)); }
 }
 
 using ss::OpCode;
@@ -168,7 +183,23 @@ TEST(Scanner, METHOD(scan, some_code))
   for (std::size_t i = 0; i < expected.size(); i++) { EXPECT_EQ(expected[i], tokens[i]) << "i: " << i; }
 }
 
+TEST(Scanner, METHOD(scan, allocates_tokens_from_the_given_resource))
+{
+  std::array<std::byte, 4096> buffer;
+  // anything that would fall back to the heap throws instead
+  std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+
+  std::string src = "let a = 1; print a;";
+  Scanner scanner(std::move(src), &arena);
+
+  auto tokens = scanner.scan();
+
+  EXPECT_EQ(tokens.get_allocator().resource(), &arena);
+  EXPECT_EQ(tokens.size(), 9);
+}
+
 using ss::Instruction;
+using ss::JumpTable;
 using ss::Local;
 using ss::OpCode;
 using ss::Parser;
@@ -180,9 +211,9 @@ TEST(Parser, METHOD(parse, some_math))
 
   auto tokens = scanner.scan();
 
-  BytecodeChunk chunk;
+  Program program;
 
-  Parser parser(std::move(tokens), chunk, "TEST");
+  Parser parser(std::move(tokens), program, "TEST");
 
   EXPECT_NO_THROW(parser.parse());
 
@@ -203,5 +234,293 @@ TEST(Parser, METHOD(parse, some_math))
    Instruction{OpCode::END},
   };
 
-  ASSERT_EQ(expected.size(), chunk.instruction_count());
+  ASSERT_EQ(expected.size(), program.instruction_count());
+}
+
+using ss::Compiler;
+
+TEST(Compiler, METHOD(compile, is_deterministic_when_compiling_concurrently))
+{
+  constexpr std::size_t COMPILES = 2048;
+
+  const std::string src = TEST_SCRIPT(
+    let x = 0;
+    fn add(a, b) {
+      let sum = a + b;
+      ret sum;
+    }
+    for let i = 0; i < 10; i = i + 1 {
+      if i % 2 == 0 {
+        cont;
+      }
+      x = add(x, i);
+    }
+    match x {
+      25 => print "twenty five";
+      "str" => print x;
+    }
+    while x > 0 {
+      x = x - 1;
+      if x == 3 {
+        break;
+      }
+    }
+    print x and !nil or false;
+  );
+
+  auto compile = [&src](Program& program) {
+    Compiler compiler;
+    compiler.compile(std::string(src), program, "TEST");
+  };
+
+  Program expected;
+  compile(expected);
+
+  std::size_t thread_count = std::max(2U, std::thread::hardware_concurrency());
+  std::atomic_size_t mismatches = 0;
+  std::vector<std::thread> threads;
+
+  for (std::size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back([&, t] {
+      for (std::size_t i = t; i < COMPILES; i += thread_count) {
+        Program program;
+        compile(program);
+
+        bool same = program.instruction_count() == expected.instruction_count() &&
+                    program.constant_count() == expected.constant_count() &&
+                    std::equal(program.begin(), program.end(), expected.begin());
+
+        for (std::size_t c = 0; same && c < program.constant_count(); c++) {
+          same = program.constant_at(c).to_string() == expected.constant_at(c).to_string();
+        }
+
+        if (!same) {
+          mismatches++;
+        }
+      }
+    });
+  }
+
+  for (auto& thread : threads) { thread.join(); }
+
+  EXPECT_EQ(mismatches, 0);
+}
+
+using ss::SourceLocation;
+
+TEST_F(TestProgram, METHOD(location_at, maps_offsets_to_full_locations))
+{
+  auto main_file = this->program.add_file("main.ss");
+  auto lib_file  = this->program.add_file("lib.ss");
+
+  this->program.write(Instruction{OpCode::NIL}, SourceLocation{1, 3, main_file});
+  this->program.write(Instruction{OpCode::POP}, SourceLocation{1, 3, main_file});
+  this->program.write(Instruction{OpCode::TRUE}, SourceLocation{1, 7, main_file});
+  this->program.write(Instruction{OpCode::TRUE}, SourceLocation{1, 7, lib_file});
+  this->program.write(Instruction{OpCode::END}, SourceLocation{4, 1, main_file});
+
+  EXPECT_EQ(this->program.add_file("lib.ss"), lib_file);
+  EXPECT_EQ(this->program.file_name(lib_file), "lib.ss");
+
+  EXPECT_EQ(this->program.location_at(0), (SourceLocation{1, 3, main_file}));
+  EXPECT_EQ(this->program.location_at(1), (SourceLocation{1, 3, main_file}));
+  EXPECT_EQ(this->program.location_at(2), (SourceLocation{1, 7, main_file}));
+  EXPECT_EQ(this->program.location_at(3), (SourceLocation{1, 7, lib_file}));
+  EXPECT_EQ(this->program.location_at(4), (SourceLocation{4, 1, main_file}));
+}
+
+TEST_F(TestProgram, METHOD(line_at, finds_lines_across_many_runs))
+{
+  for (std::size_t i = 0; i < 10000; i++) { this->program.write(Instruction{OpCode::NO_OP}, i / 3 + 1); }
+
+  for (std::size_t i = 0; i < 10000; i++) { ASSERT_EQ(this->program.line_at(i), i / 3 + 1) << "i: " << i; }
+}
+
+namespace
+{
+  auto compile_opcodes(std::string src) -> std::vector<OpCode>
+  {
+    Program program;
+    Compiler compiler;
+    compiler.compile(std::move(src), program, "TEST");
+
+    std::vector<OpCode> opcodes;
+    for (const auto& i : program) { opcodes.push_back(i.major_opcode); }
+    return opcodes;
+  }
+
+  auto count_opcode(const std::vector<OpCode>& opcodes, OpCode op) -> std::size_t
+  {
+    return std::count(opcodes.begin(), opcodes.end(), op);
+  }
+}  // namespace
+
+TEST(Parser, METHOD(parse, does_not_emit_code_after_ret_break_cont_or_end))
+{
+  auto opcodes = compile_opcodes(TEST_SCRIPT(fn f() {
+    ret 1;
+    print 2;
+  } loop {
+    break;
+    print 3;
+  } end;
+  print 4;));
+
+  EXPECT_EQ(count_opcode(opcodes, OpCode::PRINT), 0);
+  EXPECT_EQ(opcodes.back(), OpCode::END);
+  // the explicit ret makes the implicit one dead, and the break makes the loop's back edge dead
+  EXPECT_EQ(count_opcode(opcodes, OpCode::RETURN), 1);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::LOOP), 0);
+}
+
+TEST(Parser, METHOD(parse, folds_literal_if_and_while_conditions))
+{
+  auto opcodes = compile_opcodes(TEST_SCRIPT(if false { print 1; } else { print 2; } if 1 {
+    print 3;
+  } else {
+    print 4;
+  } while nil { print 5; }));
+
+  EXPECT_EQ(count_opcode(opcodes, OpCode::PRINT), 2);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::JUMP_IF_FALSE), 0);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::JUMP), 0);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::LOOP), 0);
+
+  opcodes = compile_opcodes(TEST_SCRIPT(while true { break; }));
+
+  EXPECT_EQ(count_opcode(opcodes, OpCode::JUMP_IF_FALSE), 0);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::JUMP), 1);
+}
+
+TEST(Parser, METHOD(parse, fuses_counted_for_loops))
+{
+  auto opcodes = compile_opcodes(TEST_SCRIPT(for let i = 0; i < 10; i = i + 1 { print i; }));
+
+  EXPECT_EQ(count_opcode(opcodes, OpCode::FOR_PREP), 1);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::FOR_LOOP), 1);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::LESS), 0);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::LOOP), 0);
+
+  // the limit may change inside the body, so it has to be checked every iteration
+  opcodes = compile_opcodes(TEST_SCRIPT(let n = 10; for let i = 0; i < n; i = i + 1 { n = f(i); }));
+
+  EXPECT_EQ(count_opcode(opcodes, OpCode::FOR_LOOP), 0);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::LESS), 1);
+}
+
+TEST(Parser, METHOD(parse, adds_onto_variables_in_place))
+{
+  auto opcodes = compile_opcodes(TEST_SCRIPT(let s = ""; s = s + "a" * 2; {
+    let l = 1;
+    l = l + 2;
+    print l = l + 3;
+  }));
+
+  EXPECT_EQ(count_opcode(opcodes, OpCode::ADD_ASSIGN_GLOBAL), 1);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::ADD_ASSIGN_LOCAL), 2);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::ADD), 0);
+
+  // the operand could change the variable first, or the sum is only part of the right side
+  opcodes = compile_opcodes(TEST_SCRIPT(let s = ""; s = s + f(); s = s + "a" + "b"; s = "a" + s; {
+    let l = 1;
+    l = l + (l = 2);
+    l = l + 1 == 2;
+    l = l + -1;
+  }));
+
+  EXPECT_EQ(count_opcode(opcodes, OpCode::ADD_ASSIGN_GLOBAL), 0);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::ADD_ASSIGN_LOCAL), 0);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::ADD), 7);
+}
+
+TEST(Parser, METHOD(parse, dispatches_literal_matches_through_a_table))
+{
+  auto opcodes = compile_opcodes(TEST_SCRIPT(match x { 1 => print 1; 2 => print 2; "three" => print 3; }));
+
+  EXPECT_EQ(count_opcode(opcodes, OpCode::MATCH_TABLE), 1);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::CHECK), 0);
+
+  // patterns that are not literals still have to be compared in order
+  opcodes = compile_opcodes(TEST_SCRIPT(match x { 1 => print 1; y => print 2; }));
+
+  EXPECT_EQ(count_opcode(opcodes, OpCode::MATCH_TABLE), 0);
+  EXPECT_EQ(count_opcode(opcodes, OpCode::CHECK), 2);
+}
+
+TEST(JumpTable, METHOD(offset_for, selects_the_arm_or_the_default))
+{
+  JumpTable table;
+  table.dense_base      = 4;
+  table.dense           = {1, 0, 5};
+  table.strings["four"] = 9;
+  table.default_offset  = 12;
+
+  EXPECT_EQ(table.offset_for(Value(4.0)), 1);
+  EXPECT_EQ(table.offset_for(Value(5.0)), 12);
+  EXPECT_EQ(table.offset_for(Value(6.0)), 5);
+  EXPECT_EQ(table.offset_for(Value(4.5)), 12);
+  EXPECT_EQ(table.offset_for(Value(7.0)), 12);
+  EXPECT_EQ(table.offset_for(Value("four")), 9);
+  EXPECT_EQ(table.offset_for(Value(true)), 12);
+}
+
+TEST_F(TestProgram, METHOD(max_stack_depth, takes_the_deepest_path_until_each_ends))
+{
+  this->program.write(Instruction{OpCode::TRUE}, 1);
+  this->program.write(Instruction{OpCode::JUMP_IF_FALSE, 4}, 1);
+  this->program.write(Instruction{OpCode::NIL}, 1);
+  this->program.write(Instruction{OpCode::NIL}, 1);
+  this->program.write(Instruction{OpCode::POP_N, 2}, 1);
+  this->program.write(Instruction{OpCode::POP}, 1);
+  this->program.write(Instruction{OpCode::END}, 1);
+
+  EXPECT_EQ(this->program.max_stack_depth(0), 3);
+  EXPECT_EQ(this->program.max_stack_depth(2), 2);
+  EXPECT_EQ(this->program.max_stack_depth(5), 0);
+}
+
+TEST(Parser, METHOD(parse, records_how_deep_functions_push))
+{
+  Program program;
+  Compiler compiler;
+  compiler.compile(TEST_SCRIPT(fn f(a) { ret a + (a * (a - 1)); } print f(1);), program, "TEST");
+
+  ASSERT_EQ(program.functions().size(), 1);
+  EXPECT_EQ(program.functions().front()->max_stack, 4);
+}
+
+using ss::CompiletimeError;
+
+TEST(Program, METHOD(verify, accepts_compiled_code_and_rejects_anything_unsound))
+{
+  auto build = [](std::initializer_list<Instruction> instructions) {
+    Program program;
+    program.insert_constant(Value(1.0));
+    program.insert_constant(Value("name"));
+    for (auto instruction : instructions) { program.write(instruction, 1); }
+    return program;
+  };
+
+  Program compiled;
+  Compiler compiler;
+  compiler.compile(TEST_SCRIPT(fn f(a) { let b = a; ret b + 1; } let x = f(1); match x { 1 => print x; }), compiled, "TEST");
+  EXPECT_NO_THROW(compiled.verify(0));
+
+  EXPECT_NO_THROW(build({{OpCode::CONSTANT, 0}, {OpCode::DEFINE_GLOBAL, 1}, {OpCode::END}}).verify(0));
+  // pops what it never pushed
+  EXPECT_THROW(build({{OpCode::ADD}, {OpCode::END}}).verify(0), CompiletimeError);
+  // names a global with a number
+  EXPECT_THROW(build({{OpCode::LOOKUP_GLOBAL, 0}, {OpCode::END}}).verify(0), CompiletimeError);
+  // reads a constant past the end
+  EXPECT_THROW(build({{OpCode::CONSTANT, 2}, {OpCode::END}}).verify(0), CompiletimeError);
+  // jumps outside the code
+  EXPECT_THROW(build({{OpCode::JUMP, 5}, {OpCode::END}}).verify(0), CompiletimeError);
+  // runs off the end
+  EXPECT_THROW(build({{OpCode::NIL}}).verify(0), CompiletimeError);
+  // the two paths meet with different depths
+  EXPECT_THROW(build({{OpCode::TRUE}, {OpCode::JUMP_IF_FALSE, 2}, {OpCode::NIL}, {OpCode::END}}).verify(0), CompiletimeError);
+  // calls without the stack pointer & return address a return pops
+  EXPECT_THROW(build({{OpCode::CONSTANT, 0}, {OpCode::CALL, 0}, {OpCode::END}}).verify(0), CompiletimeError);
+  // returns outside of a function
+  EXPECT_THROW(build({{OpCode::NIL}, {OpCode::RETURN, 0}}).verify(0), CompiletimeError);
 }
@@ -2,7 +2,10 @@
 #include "ss/exceptions.hpp"
 #include "ss/vm.hpp"
 
+#include <cmath>
 #include <gtest/gtest.h>
+#include <limits>
+#include <sstream>
 
 using ss::RuntimeError;
 using ss::Value;
@@ -46,6 +49,17 @@ TEST(Value, METHOD(string, when_not_a_string_returns_empty_string))
   EXPECT_EQ(v.string(), "");
 }
 
+TEST(Value, METHOD(string, round_trips_std_strings_from_the_host))
+{
+  std::string host = "host";
+  Value v(host);
+  std::string s = v.string();
+  EXPECT_EQ(s, "host");
+
+  v = std::string("again");
+  EXPECT_EQ(v.string_ref(), "again");
+}
+
 TEST(Value, METHOD(to_string, when_nil_returns_the_word_nil))
 {
   Value v;
@@ -66,6 +80,36 @@ TEST(Value, METHOD(to_string, when_a_number_returns_string_repr))
   EXPECT_EQ(v.to_string(), "1.2345");
 }
 
+TEST(Value, METHOD(to_string, formats_numbers_the_same_as_a_stream))
+{
+  const Value::NumberType numbers[] = {
+   0,
+   -0.0,
+   7,
+   -42,
+   999999,
+   1000000,
+   1234567,
+   0.5,
+   0.1 + 0.2,
+   1.0 / 3,
+   3.14159265,
+   1e-5,
+   -2.5e-300,
+   1.7976931348623157e308,
+   std::numeric_limits<Value::NumberType>::infinity(),
+   -std::numeric_limits<Value::NumberType>::infinity(),
+   std::nan(""),
+  };
+
+  for (auto number : numbers) {
+    std::ostringstream expected;
+    expected << number;
+    EXPECT_EQ(Value(number).to_string(), expected.str());
+    EXPECT_EQ((Value("n") + Value(number)).to_string(), "n" + expected.str());
+  }
+}
+
 TEST(Value, METHOD(to_string, when_string_returns_internal_value))
 {
   Value v("string");
@@ -307,3 +351,10 @@ TEST(Value, METHOD(assign_operator, can_assign))
   x = Value::nil;
   EXPECT_EQ(x, nil);
 }
+
+TEST(Value, METHOD(operator_less_equal, includes_equal_values))
+{
+  EXPECT_TRUE(Value(1.0) <= Value(1.0));
+  EXPECT_TRUE(Value(1.0) <= Value(2.0));
+  EXPECT_FALSE(Value(2.0) <= Value(1.0));
+}
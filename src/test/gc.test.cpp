@@ -0,0 +1,269 @@
+#include "ss/code.hpp"
+#include "ss/gc.hpp"
+#include "ss/vm.hpp"
+
+#include "helpers.hpp"
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+#define TEST_SCRIPT(src) #src
+
+using ss::ExecutionContext;
+using ss::Function;
+using ss::Heap;
+using ss::HeapConfig;
+using ss::NativeFunction;
+using ss::Nursery;
+using ss::Object;
+using ss::Program;
+using ss::Value;
+using ss::VM;
+using ss::VMConfig;
+
+namespace
+{
+  /**
+   * @brief Stands in for a container, referencing another object and counting how many are alive
+   */
+  class Node: public Object
+  {
+   public:
+    Node(int& alive, const Node* child = nullptr)
+     : alive(alive)
+     , child(child)
+    {
+      this->alive++;
+    }
+
+    ~Node() override
+    {
+      this->alive--;
+    }
+
+    void trace(Heap& heap) const override
+    {
+      heap.mark(this->child);
+    }
+
+   private:
+    int& alive;
+    const Node* child;
+  };
+}  // namespace
+
+TEST(Heap, METHOD(collect, frees_only_unreachable_objects))
+{
+  int alive = 0;
+  Heap heap;
+
+  auto leaf   = heap.make<Node>(alive);
+  auto root   = heap.make<Node>(alive, leaf);
+  auto orphan = heap.make<Node>(alive);
+  (void)orphan;
+
+  EXPECT_EQ(alive, 3);
+  EXPECT_EQ(heap.statistics().objects, 3);
+
+  heap.collect([root](Heap& h) { h.mark(root); });
+
+  EXPECT_EQ(alive, 2);
+  EXPECT_EQ(heap.statistics().objects, 2);
+  EXPECT_EQ(heap.statistics().objects_freed, 1);
+  EXPECT_EQ(heap.statistics().bytes_freed, sizeof(Node));
+  EXPECT_EQ(heap.statistics().collections, 1);
+
+  heap.collect([](Heap&) {});
+
+  EXPECT_EQ(alive, 0);
+}
+
+TEST(Heap, METHOD(collect, handles_cycles))
+{
+  int alive = 0;
+  Heap heap;
+
+  // a node referencing itself is the smallest cycle, reference counting would never free it
+  auto node = heap.make<Node>(alive);
+  node      = heap.make<Node>(alive, node);
+  heap.collect([](Heap&) {});
+
+  EXPECT_EQ(alive, 0);
+}
+
+TEST(Heap, METHOD(should_collect, follows_the_growth_threshold))
+{
+  int alive = 0;
+  Heap heap(HeapConfig{sizeof(Node) * 2, 2.0});
+
+  auto first = heap.make<Node>(alive);
+  EXPECT_FALSE(heap.should_collect());
+  heap.make<Node>(alive);
+  EXPECT_TRUE(heap.should_collect());
+
+  heap.collect([first](Heap& h) { h.mark(first); });
+
+  // one object survived, the threshold never drops below the initial one
+  EXPECT_FALSE(heap.should_collect());
+  EXPECT_EQ(heap.statistics().bytes, sizeof(Node));
+}
+
+TEST(Heap, METHOD(destructor, frees_everything))
+{
+  int alive = 0;
+  {
+    Heap heap;
+    heap.make<Node>(alive);
+    heap.make<Node>(alive);
+  }
+  EXPECT_EQ(alive, 0);
+}
+
+TEST(Nursery, METHOD(allocate, bumps_until_exhausted))
+{
+  Nursery nursery(64);
+
+  auto first  = nursery.allocate(16, 8);
+  auto second = nursery.allocate(16, 8);
+
+  EXPECT_EQ(static_cast<std::byte*>(second) - static_cast<std::byte*>(first), 16);
+  EXPECT_EQ(nursery.used(), 32);
+  EXPECT_FALSE(nursery.exhausted());
+
+  // freeing the top gives the space back, anything below waits for a reset
+  nursery.deallocate(second, 16, 8);
+  EXPECT_EQ(nursery.used(), 16);
+  nursery.deallocate(first, 16, 8);
+  EXPECT_EQ(nursery.used(), 0);
+
+  std::vector<void*> allocations;
+  for (int i = 0; i < 5; i++) { allocations.push_back(nursery.allocate(16, 8)); }
+  EXPECT_TRUE(nursery.exhausted());
+
+  for (auto ptr : allocations) { nursery.deallocate(ptr, 16, 8); }
+  nursery.reset();
+
+  EXPECT_EQ(nursery.used(), 0);
+  EXPECT_FALSE(nursery.exhausted());
+}
+
+TEST(Nursery, METHOD(allocate, sends_large_requests_upstream))
+{
+  Nursery nursery(64);
+
+  auto large = nursery.allocate(32, 8);
+
+  EXPECT_EQ(nursery.used(), 0);
+  EXPECT_FALSE(nursery.exhausted());
+
+  nursery.deallocate(large, 32, 8);
+}
+
+TEST(ExecutionContext, METHOD(string_resource, promotes_survivors_once_the_nursery_fills))
+{
+  ExecutionContext context(HeapConfig{.nursery_size = 256});
+
+  auto nursery = context.string_resource();
+  auto text    = "long enough to not fit in the small string buffer";
+  context.push_stack(Value(Value::StringType(text, nursery)));
+  context.set_global("global", Value(Value::StringType(text, nursery)));
+
+  // values are copied out of the context, and copies never keep the nursery
+  EXPECT_FALSE(context.peek_stack().allocated_by(nursery));
+  EXPECT_EQ(context.heap_stats().minor_collections, 0);
+
+  // fill it until an allocation spills over
+  std::vector<Value> temporaries;
+  for (int i = 0; i < 4; i++) { temporaries.emplace_back(Value::StringType(text, nursery)); }
+  temporaries.clear();
+
+  EXPECT_EQ(context.string_resource(), nursery);
+  EXPECT_EQ(context.heap_stats().minor_collections, 1);
+  EXPECT_EQ(context.heap_stats().strings_promoted, 2);
+  EXPECT_FALSE(context.find_global("global")->second.allocated_by(nursery));
+  EXPECT_EQ(context.pop_stack().string(), text);
+  EXPECT_EQ(context.find_global("global")->second.string(), text);
+}
+
+TEST(VM, METHOD(run_script, keeps_strings_that_outlive_the_nursery))
+{
+  std::ostringstream out;
+  VM vm(VMConfig(&std::cin, &out), HeapConfig{.nursery_size = 256});
+
+  vm.run_script(TEST_SCRIPT(let kept = ""; fn build() {
+    let str = "";
+    for let i = 0; i < 100; i = i + 1 {
+      str = str + "line " + i + "; ";
+      kept = "last line was " + i;
+    }
+    ret str;
+  } let result = build(); print kept;));
+
+  EXPECT_EQ(out.str(), "last line was 99\n");
+  EXPECT_GT(vm.heap_stats().minor_collections, 0);
+
+  std::string expected;
+  for (int i = 0; i < 100; i++) { expected += "line " + std::to_string(i) + "; "; }
+  EXPECT_EQ(vm.get_var("result").to_string(), expected);
+}
+
+TEST(ExecutionContext, METHOD(collect_garbage, keeps_globals_and_the_stack))
+{
+  ExecutionContext context;
+  Program program;
+
+  context.set_global("global", Value(context.make<Function>("global", 0, 0, 0)));
+  context.push_stack(Value(context.make<NativeFunction>("stack", 0, [](NativeFunction::Args&&) { return Value(); })));
+  context.make<Function>("garbage", 0, 0, 0);
+  // owned by the program, so the heap never counts nor frees it
+  context.set_global("compiled", Value(program.make_function("compiled", 0, 0, 0)));
+
+  context.collect_garbage();
+
+  EXPECT_EQ(context.heap_stats().objects, 2);
+  EXPECT_EQ(context.heap_stats().objects_freed, 1);
+
+  // a new program drops the stack, but globals remain
+  context.prepare();
+  context.collect_garbage();
+
+  EXPECT_EQ(context.heap_stats().objects, 1);
+  EXPECT_EQ(context.find_global("global")->second.function()->name, "global");
+  EXPECT_EQ(context.find_global("compiled")->second.function()->name, "compiled");
+}
+
+TEST(VM, METHOD(collect_garbage, keeps_natives_and_their_arguments_while_they_run))
+{
+  std::ostringstream out;
+  VM vm(VMConfig(&std::cin, &out));
+
+  vm.set_var("factory", Value(vm.make<NativeFunction>("factory", 0, [&](NativeFunction::Args&&) {
+               return Value(vm.make<NativeFunction>("made", 0, [](NativeFunction::Args&&) { return Value("made"); }));
+             })));
+  vm.set_var("apply", Value(vm.make<NativeFunction>("apply", 1, [&](NativeFunction::Args&& args) {
+               vm.collect_garbage();
+               return vm.call(args[0]);
+             })));
+  vm.run_script("print apply(factory());");
+
+  EXPECT_EQ(out.str(), "made\n");
+  EXPECT_EQ(vm.heap_stats().objects_freed, 0);
+}
+
+TEST(VM, METHOD(collect_garbage, frees_replaced_natives))
+{
+  std::ostringstream out;
+  VM vm(VMConfig(&std::cin, &out));
+
+  auto native = [](NativeFunction::Args&&) { return Value("native"); };
+  vm.set_var("native", Value(vm.make<NativeFunction>("first", 0, native)));
+  vm.set_var("native", Value(vm.make<NativeFunction>("second", 0, native)));
+  vm.run_script("fn call() { ret native(); } print call();");
+
+  vm.collect_garbage();
+
+  EXPECT_EQ(out.str(), "native\n");
+  EXPECT_EQ(vm.heap_stats().objects_freed, 1);
+  EXPECT_EQ(vm.get_var("native").native()->name, "second");
+  EXPECT_EQ(vm.get_var("call").function()->name, "call");
+}
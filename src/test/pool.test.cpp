@@ -0,0 +1,123 @@
+#include "ss/exceptions.hpp"
+#include "ss/pool.hpp"
+
+#include "helpers.hpp"
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#define TEST_SCRIPT(src) #src
+
+using ss::CompiletimeError;
+using ss::NativeFunction;
+using ss::RuntimeError;
+using ss::Value;
+using ss::VM;
+using ss::VMConfig;
+using ss::VMPool;
+
+TEST(VMPool, METHOD(acquire, reuses_returned_vms))
+{
+  VMPool pool(TEST_SCRIPT(let runs = 0; fn count() {
+    runs = runs + 1;
+    ret runs;
+  }));
+
+  EXPECT_EQ(pool.size(), 0);
+
+  {
+    auto vm = pool.acquire();
+    EXPECT_EQ(vm->call(vm->get_var("count")).number(), 1);
+    EXPECT_EQ(pool.size(), 1);
+    EXPECT_EQ(pool.idle_count(), 0);
+  }
+
+  EXPECT_EQ(pool.idle_count(), 1);
+
+  // the same vm comes back with the global it left behind, and the script isn't run again
+  auto vm = pool.acquire();
+  EXPECT_EQ(vm->call(vm->get_var("count")).number(), 2);
+  EXPECT_EQ(pool.size(), 1);
+}
+
+TEST(VMPool, METHOD(acquire, creates_vms_with_their_own_state))
+{
+  std::ostringstream output;
+  VMPool pool(
+   TEST_SCRIPT(let total = base; print "ready"; fn add(n) {
+     total = total + n;
+     ret total;
+   }),
+   [](VM& vm) { vm.set_var("base", Value(10.0)); },
+   VMConfig(&std::cin, &output));
+
+  auto a = pool.acquire();
+  auto b = pool.acquire();
+
+  EXPECT_EQ(pool.size(), 2);
+  EXPECT_EQ(output.str(), "ready\nready\n");
+
+  EXPECT_EQ(a->call(a->get_var("add"), 1.0).number(), 11);
+  EXPECT_EQ(a->call(a->get_var("add"), 1.0).number(), 12);
+  EXPECT_EQ(b->call(b->get_var("add"), 5.0).number(), 15);
+
+  // the vms share the program's functions, which no vm's heap owns, so collecting one leaves the rest working
+  EXPECT_EQ(a->get_var("add").function(), b->get_var("add").function());
+  a->collect_garbage();
+  b->collect_garbage();
+  EXPECT_EQ(b->call(b->get_var("add"), 5.0).number(), 20);
+}
+
+TEST(VMPool, METHOD(acquire, runs_vms_on_many_threads))
+{
+  VMPool pool(
+   TEST_SCRIPT(fn fib(n) {
+     if n <= 1 {
+       ret n;
+     }
+     ret fib(n - 1) + fib(n - 2);
+   } fn label(n) { ret "fib " + n; }),
+   [](VM& vm) {
+     vm.set_var("identity", Value(vm.make<NativeFunction>("identity", 1, [](NativeFunction::Args&& args) {
+                  return args[0];
+                })));
+   });
+
+  constexpr int THREADS = 4;
+  std::vector<std::thread> threads;
+  std::vector<Value::NumberType> results(THREADS);
+  std::vector<std::string> labels(THREADS);
+
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([&pool, &results, &labels, t] {
+      for (int i = 0; i < 20; i++) {
+        auto vm    = pool.acquire();
+        results[t] = vm->call(vm->get_var("fib"), 15.0).number();
+        labels[t]  = vm->call(vm->get_var("label"), static_cast<Value::NumberType>(t)).to_string();
+      }
+    });
+  }
+  for (auto& thread : threads) { thread.join(); }
+
+  for (int t = 0; t < THREADS; t++) {
+    EXPECT_EQ(results[t], 610);
+    EXPECT_EQ(labels[t], "fib " + std::to_string(t));
+  }
+  EXPECT_LE(pool.size(), THREADS);
+  EXPECT_EQ(pool.idle_count(), pool.size());
+}
+
+TEST(VMPool, METHOD(constructor, rejects_invalid_scripts))
+{
+  EXPECT_THROW(VMPool pool("fn broken( {"), CompiletimeError);
+}
+
+TEST(VMPool, METHOD(acquire, keeps_no_vm_whose_script_failed))
+{
+  VMPool pool(TEST_SCRIPT(let value = missing;));
+
+  EXPECT_THROW(pool.acquire(), RuntimeError);
+  EXPECT_EQ(pool.size(), 0);
+}
@@ -0,0 +1,149 @@
+#include "ss/profiler.hpp"
+
+#include "helpers.hpp"
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using ss::FunctionProfiler;
+using ss::Instruction;
+using ss::OpCode;
+using ss::OpcodeProfiler;
+using ss::Program;
+using ss::SourceLocation;
+using ss::VMConfig;
+
+class TestOpcodeProfiler: public testing::Test
+{
+ protected:
+  OpcodeProfiler profiler;
+};
+
+TEST_F(TestOpcodeProfiler, METHOD(enter, counts_opcodes_and_offsets))
+{
+  this->profiler.enter(0, OpCode::CONSTANT);
+  this->profiler.enter(1, OpCode::CONSTANT);
+  this->profiler.enter(2, OpCode::ADD);
+  this->profiler.enter(1, OpCode::CONSTANT);
+  this->profiler.stop();
+
+  EXPECT_EQ(this->profiler.opcode_counter(OpCode::CONSTANT).executions, 3);
+  EXPECT_EQ(this->profiler.opcode_counter(OpCode::ADD).executions, 1);
+  EXPECT_EQ(this->profiler.opcode_counter(OpCode::PRINT).executions, 0);
+  EXPECT_EQ(this->profiler.offset_counter(1).executions, 2);
+  EXPECT_EQ(this->profiler.offset_counter(7).executions, 0);
+}
+
+TEST_F(TestOpcodeProfiler, METHOD(stop, charges_time_to_the_last_instruction))
+{
+  this->profiler.enter(0, OpCode::PRINT);
+  auto start = OpcodeProfiler::now();
+  while (OpcodeProfiler::now() == start) {}
+  this->profiler.stop();
+
+  EXPECT_GT(this->profiler.opcode_counter(OpCode::PRINT).ticks, 0);
+  EXPECT_EQ(this->profiler.opcode_counter(OpCode::PRINT).ticks, this->profiler.offset_counter(0).ticks);
+}
+
+TEST_F(TestOpcodeProfiler, METHOD(reset, discards_everything))
+{
+  this->profiler.enter(0, OpCode::PRINT);
+  this->profiler.reset();
+
+  EXPECT_EQ(this->profiler.opcode_counter(OpCode::PRINT).executions, 0);
+  EXPECT_EQ(this->profiler.offset_counter(0).executions, 0);
+}
+
+TEST_F(TestOpcodeProfiler, METHOD(report, maps_hot_spots_to_lines))
+{
+  Program program;
+  auto file = program.add_file("profiled.ss");
+  program.write(Instruction{OpCode::NIL}, SourceLocation{3, 1, file});
+  program.write(Instruction{OpCode::PRINT}, SourceLocation{3, 5, file});
+  program.write(Instruction{OpCode::END}, SourceLocation{4, 1, file});
+
+  this->profiler.enter(0, OpCode::NIL);
+  this->profiler.enter(1, OpCode::PRINT);
+  this->profiler.enter(2, OpCode::END);
+  this->profiler.stop();
+
+  std::ostringstream out;
+  VMConfig cfg(&std::cin, &out);
+  this->profiler.report(program, cfg);
+
+  auto report = out.str();
+  EXPECT_NE(report.find("OPCODES"), std::string::npos);
+  EXPECT_NE(report.find("PRINT"), std::string::npos);
+  EXPECT_NE(report.find("HOT SPOTS"), std::string::npos);
+  EXPECT_NE(report.find("profiled.ss:3 "), std::string::npos);
+  EXPECT_NE(report.find("profiled.ss:4 "), std::string::npos);
+}
+
+class TestFunctionProfiler: public testing::Test
+{
+ protected:
+  FunctionProfiler profiler;
+};
+
+TEST_F(TestFunctionProfiler, METHOD(leave, splits_inclusive_and_exclusive_time))
+{
+  auto spin = [] {
+    auto start = OpcodeProfiler::now();
+    while (OpcodeProfiler::now() == start) {}
+  };
+
+  this->profiler.enter("script");
+  spin();
+  this->profiler.enter("outer");
+  spin();
+  this->profiler.enter("inner");
+  spin();
+  this->profiler.leave();
+  this->profiler.leave();
+  this->profiler.stop();
+
+  auto outer = this->profiler.timing("outer");
+  auto inner = this->profiler.timing("inner");
+
+  EXPECT_EQ(outer.calls, 1);
+  EXPECT_EQ(inner.calls, 1);
+  EXPECT_GT(inner.exclusive, 0);
+  EXPECT_EQ(inner.inclusive, inner.exclusive);
+  EXPECT_EQ(outer.inclusive, outer.exclusive + inner.inclusive);
+  EXPECT_EQ(this->profiler.timing("missing").calls, 0);
+}
+
+TEST_F(TestFunctionProfiler, METHOD(leave, counts_recursion_once_in_inclusive_time))
+{
+  this->profiler.enter("fib");
+  this->profiler.enter("fib");
+  this->profiler.leave();
+  this->profiler.leave();
+
+  auto fib = this->profiler.timing("fib");
+
+  EXPECT_EQ(fib.calls, 2);
+  EXPECT_EQ(fib.inclusive, fib.exclusive);
+}
+
+TEST_F(TestFunctionProfiler, METHOD(write_folded, emits_one_line_per_stack))
+{
+  this->profiler.enter("script");
+  this->profiler.enter("a");
+  this->profiler.enter("b");
+  this->profiler.leave();
+  this->profiler.leave();
+  this->profiler.enter("b");
+  this->profiler.stop();
+
+  std::ostringstream out;
+  this->profiler.write_folded(out);
+
+  std::vector<std::string> stacks;
+  std::istringstream lines(out.str());
+  for (std::string line; std::getline(lines, line);) { stacks.push_back(line.substr(0, line.rfind(' '))); }
+
+  EXPECT_EQ(stacks, (std::vector<std::string>{"script", "script;a", "script;a;b", "script;b"}));
+}
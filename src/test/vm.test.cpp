@@ -1,24 +1,34 @@
+#include "ss/exceptions.hpp"
 #include "ss/vm.hpp"
 
 #include "helpers.hpp"
 
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
 
 #define TEST_SCRIPT(src) #src
 
+using ss::CompiledScript;
+using ss::CompiletimeError;
+using ss::Dispatch;
+using ss::HeapConfig;
 using ss::NativeFunction;
+using ss::OutputConfig;
+using ss::ProfileConfig;
+using ss::RuntimeError;
 using ss::Value;
 using ss::VM;
 using ss::VMConfig;
 
-class TestVM: public testing::Test
+class TestVM: public testing::TestWithParam<Dispatch>
 {
  public:
   void SetUp() override
 
   {
     this->ostream = std::make_shared<std::ostringstream>();
-    this->vm      = std::make_shared<VM>(VMConfig(&std::cin, this->ostream.get()));
+    this->vm      = std::make_shared<VM>(VMConfig(&std::cin, this->ostream.get(), OutputConfig(), GetParam()));
   }
 
  protected:
@@ -26,7 +36,9 @@ class TestVM: public testing::Test
   std::shared_ptr<VM> vm;
 };
 
-TEST_F(TestVM, prints_correctly)
+INSTANTIATE_TEST_SUITE_P(Dispatches, TestVM, testing::Values(Dispatch::PLAIN, Dispatch::CACHED_TOP, Dispatch::TAIL_CALL));
+
+TEST_P(TestVM, prints_correctly)
 {
   const char* script = {
 #include "scripts/print_script.ss"
@@ -37,7 +49,7 @@ TEST_F(TestVM, prints_correctly)
   ASSERT_EQ(this->ostream->str(), "true\nhello world\n");
 }
 
-TEST_F(TestVM, setting_and_getting_vars)
+TEST_P(TestVM, setting_and_getting_vars)
 {
   const char* script = {
 #include "scripts/var_script.ss"
@@ -50,7 +62,7 @@ TEST_F(TestVM, setting_and_getting_vars)
   EXPECT_EQ(this->vm->get_var("value"), Value(true));
 }
 
-TEST_F(TestVM, blocks)
+TEST_P(TestVM, blocks)
 {
   const char* script = {
 #include "scripts/block_script.ss"
@@ -61,7 +73,7 @@ TEST_F(TestVM, blocks)
   EXPECT_EQ(this->ostream->str(), "string\n");
 }
 
-TEST_F(TestVM, if_statements)
+TEST_P(TestVM, if_statements)
 {
   const char* script = {
 #include "scripts/if_script.ss"
@@ -72,7 +84,7 @@ TEST_F(TestVM, if_statements)
   EXPECT_EQ(this->ostream->str(), "true\nafter\n");
 }
 
-TEST_F(TestVM, if_else_statements)
+TEST_P(TestVM, if_else_statements)
 {
   const char* script = {
 #include "scripts/if_else_script.ss"
@@ -83,13 +95,13 @@ TEST_F(TestVM, if_else_statements)
   EXPECT_EQ(this->ostream->str(), "true\nfalse\ny\nor\n");
 }
 
-TEST_F(TestVM, ands_and_ors)
+TEST_P(TestVM, ands_and_ors)
 {
   this->vm->run_script("print true or false and true;");
   EXPECT_EQ(this->ostream->str(), "true\n");
 }
 
-TEST_F(TestVM, while_stmt)
+TEST_P(TestVM, while_stmt)
 {
   const char* script = {
 #include "scripts/while_script.ss"
@@ -100,7 +112,7 @@ TEST_F(TestVM, while_stmt)
   EXPECT_EQ(this->ostream->str(), "0\n1\n2\n");
 }
 
-TEST_F(TestVM, for_stmt)
+TEST_P(TestVM, for_stmt)
 {
   const char* script = {
 #include "scripts/for_script.ss"
@@ -111,7 +123,7 @@ TEST_F(TestVM, for_stmt)
   EXPECT_EQ(this->ostream->str(), "0\n1\n2\n");
 }
 
-TEST_F(TestVM, match_stmt)
+TEST_P(TestVM, match_stmt)
 {
   const char* script = {
 #include "scripts/match_script.ss"
@@ -122,7 +134,7 @@ TEST_F(TestVM, match_stmt)
   EXPECT_EQ(this->ostream->str(), "at hello\n");
 }
 
-TEST_F(TestVM, breaks_continues)
+TEST_P(TestVM, breaks_continues)
 {
   const char* script = {
 #include "scripts/break_continue_script.ss"
@@ -133,7 +145,7 @@ TEST_F(TestVM, breaks_continues)
   EXPECT_EQ(this->ostream->str(), "0\n1\n2\n3\n4\n");
 }
 
-TEST_F(TestVM, loops)
+TEST_P(TestVM, loops)
 {
   const char* script = {
 #include "scripts/loop_script.ss"
@@ -144,7 +156,7 @@ TEST_F(TestVM, loops)
   EXPECT_EQ(this->ostream->str(), "0\n1\n2\n3\n4\n");
 }
 
-TEST_F(TestVM, complex)
+TEST_P(TestVM, complex)
 {
   const char* script = {
 #include "scripts/complex_script.ss"
@@ -155,7 +167,7 @@ TEST_F(TestVM, complex)
   EXPECT_EQ(this->ostream->str(), "1\n2\n3\n4\n5\n");
 }
 
-TEST_F(TestVM, fn)
+TEST_P(TestVM, fn)
 {
   const char* script = {
 #include "scripts/fn_script.ss"
@@ -166,7 +178,7 @@ TEST_F(TestVM, fn)
   EXPECT_EQ(this->ostream->str(), "-4\n");
 }
 
-TEST_F(TestVM, native)
+TEST_P(TestVM, native)
 {
   const char* script = {
 #include "scripts/native_script.ss"
@@ -174,8 +186,298 @@ TEST_F(TestVM, native)
 
   std::string name = "test";
   this->vm->set_var(
-   name, Value(std::make_shared<NativeFunction>(name, 0, [](NativeFunction::Args&&) { return Value("test"); })));
+   name, Value(this->vm->make<NativeFunction>(name, 0, [](NativeFunction::Args&&) { return Value("test"); })));
   this->vm->run_script(script);
 
   EXPECT_EQ(this->ostream->str(), "test\n");
 }
+
+TEST_P(TestVM, native_calls_restore_the_stack_pointer)
+{
+  std::string name = "test";
+  this->vm->set_var(
+   name, Value(this->vm->make<NativeFunction>(name, 0, [](NativeFunction::Args&&) { return Value(1.0); })));
+  this->vm->run_script(TEST_SCRIPT(fn f() {
+    let local = 2;
+    let sum   = test() + local;
+    ret sum;
+  } print f();));
+
+  EXPECT_EQ(this->ostream->str(), "3\n");
+}
+
+TEST_P(TestVM, loaded_files_do_not_end_the_script)
+{
+  auto dir = std::filesystem::temp_directory_path();
+  {
+    std::ofstream helper(dir / "ss_loadr_helper.ss");
+    helper << "let loaded = \"loaded\";";
+  }
+
+  this->vm->run_script("loadr \"ss_loadr_helper.ss\"; print loaded; print \"after\";", dir / "main.ss");
+
+  std::filesystem::remove(dir / "ss_loadr_helper.ss");
+
+  EXPECT_EQ(this->ostream->str(), "loaded\nafter\n");
+}
+
+TEST_P(TestVM, dead_code)
+{
+  const char* script = {
+#include "scripts/dead_code_script.ss"
+  };
+
+  this->vm->run_script(script);
+
+  EXPECT_EQ(this->ostream->str(), "big\n1\n0\n1\nelse\n");
+}
+
+TEST_P(TestVM, counted_for_stmt)
+{
+  const char* script = {
+#include "scripts/for_counted_script.ss"
+  };
+
+  this->vm->run_script(script);
+
+  EXPECT_EQ(this->ostream->str(), "5\n3\n2\n1\n0\n0.5\n1\n1.5\n2\n4\n9\n0\n");
+}
+
+TEST_P(TestVM, names_resolve_past_hidden_locals)
+{
+  // the counted for and the match each keep a nameless local beneath the names resolved inside them
+  this->vm->run_script(TEST_SCRIPT(fn f(n) {
+    let total = 0;
+    for let i = 0; i < n; i = i + 1 {
+      match i {
+        1 => total = total + g;
+        2 => {
+          let inner = i;
+          total = total + inner;
+        }
+      }
+    }
+    ret total;
+  } let g = 10; print f(3);));
+
+  EXPECT_EQ(this->ostream->str(), "12\n");
+}
+
+TEST_P(TestVM, add_assign)
+{
+  const char* script = {
+#include "scripts/add_assign_script.ss"
+  };
+
+  this->vm->run_script(script);
+
+  EXPECT_EQ(this->ostream->str(), "ab1true\n6\nx012y\n2s\nab\nab\n");
+}
+
+TEST_P(TestVM, match_table)
+{
+  const char* script = {
+#include "scripts/match_table_script.ss"
+  };
+
+  this->vm->run_script(script);
+
+  EXPECT_EQ(this->ostream->str(), "one\nthree\nthousand\nstring one\nnone\nnone\n1\nb2\n");
+}
+
+TEST_P(TestVM, match_exits_after_first_hit)
+{
+  const char* script = {
+#include "scripts/match_exit_script.ss"
+  };
+
+  this->vm->run_script(script);
+
+  EXPECT_EQ(this->ostream->str(), "first\n1\na\n");
+}
+
+TEST_P(TestVM, compiled_scripts_keep_earlier_functions)
+{
+  auto library = this->vm->compile(TEST_SCRIPT(fn greet(name) { ret "hello " + name; }));
+  auto main    = this->vm->compile(TEST_SCRIPT(print greet("main");));
+
+  this->vm->run(library);
+  this->vm->run(main);
+  this->vm->run(main);
+
+  EXPECT_EQ(this->ostream->str(), "hello main\nhello main\n");
+}
+
+TEST_P(TestVM, failed_compiles_leave_the_program_intact)
+{
+  auto library = this->vm->compile(TEST_SCRIPT(fn greet(name) { ret "hello " + name; }));
+
+  EXPECT_THROW(this->vm->compile("fn broken( {"), CompiletimeError);
+
+  this->vm->run(library);
+  EXPECT_EQ(this->vm->call(this->vm->get_var("greet"), "again").string(), "hello again");
+
+  this->vm->run(this->vm->compile(TEST_SCRIPT(fn twice(s) { ret greet(s) + greet(s); } print twice("x");)));
+  EXPECT_EQ(this->ostream->str(), "hello xhello x\n");
+}
+
+TEST_P(TestVM, natives_compile_while_the_script_runs)
+{
+  CompiledScript later{};
+  this->vm->set_var("define", Value(this->vm->make<NativeFunction>("define", 0, [&](NativeFunction::Args&&) {
+                      later = this->vm->compile(TEST_SCRIPT(fn later() { ret "later"; }));
+                      return Value();
+                    })));
+  this->vm->run_script(TEST_SCRIPT(define(); print "after";));
+  this->vm->run(later);
+
+  EXPECT_EQ(this->vm->call(this->vm->get_var("later")).string(), "later");
+  EXPECT_EQ(this->ostream->str(), "after\n");
+}
+
+TEST_P(TestVM, compiled_scripts_run_again_after_an_error)
+{
+  auto boom  = this->vm->compile(TEST_SCRIPT(fn boom(a, b) {
+    let c = "local";
+    ret c + nil;
+  } boom(1, 2);));
+  auto block = this->vm->compile(TEST_SCRIPT({
+    let a = 5;
+    let b = a + 1;
+    print b;
+  }));
+
+  EXPECT_THROW(this->vm->run(boom), RuntimeError);
+  this->vm->run(block);
+  EXPECT_THROW(this->vm->run(boom), RuntimeError);
+  this->vm->run(block);
+
+  EXPECT_EQ(this->ostream->str(), "6\n6\n");
+}
+
+TEST_P(TestVM, replaced_programs_keep_the_functions_globals_reference)
+{
+  this->vm->run_script(TEST_SCRIPT(fn old() { ret 1; }));
+  this->vm->run_script(TEST_SCRIPT(let x = 1;));
+  this->vm->collect_garbage();
+
+  EXPECT_EQ(this->vm->get_var("old").function()->name, "old");
+}
+
+TEST_P(TestVM, call_invokes_script_functions_from_the_host)
+{
+  this->vm->run(this->vm->compile(TEST_SCRIPT(let calls = 0; fn add(a, b) {
+    calls = calls + 1;
+    let sum = a + b;
+    ret sum;
+  })));
+
+  auto add = this->vm->get_var("add");
+  for (double i = 0; i < 1000; i++) { EXPECT_EQ(this->vm->call(add, i, 2.0).number(), i + 2); }
+
+  EXPECT_EQ(this->vm->call(add, "a", "b").string(), "ab");
+  EXPECT_EQ(this->vm->get_var("calls").number(), 1001);
+  EXPECT_THROW(this->vm->call(add, 1.0), RuntimeError);
+  EXPECT_THROW(this->vm->call(Value(1.0)), RuntimeError);
+}
+
+TEST_P(TestVM, call_recovers_from_errors_and_reenters_from_natives)
+{
+  this->vm->set_var("twice", Value(this->vm->make<NativeFunction>("twice", 1, [this](NativeFunction::Args&& args) {
+                      auto fn = args[0];
+                      return this->vm->call(fn, this->vm->call(fn, 1.0));
+                    })));
+  this->vm->run(this->vm->compile(TEST_SCRIPT(fn inc(n) { ret n + 1; } fn fail(n) { ret -nil; } fn run() {
+    let local = 10;
+    ret twice(inc) + local;
+  })));
+
+  EXPECT_THROW(this->vm->call(this->vm->get_var("fail"), 1.0), RuntimeError);
+  EXPECT_EQ(this->vm->call(this->vm->get_var("run")).number(), 13);
+  EXPECT_EQ(this->vm->call(this->vm->get_var("twice"), this->vm->get_var("inc")).number(), 3);
+}
+
+TEST_P(TestVM, deep_calls_grow_the_stack)
+{
+  // natives see the last argument first
+  this->vm->set_var("through", Value(this->vm->make<NativeFunction>("through", 2, [this](NativeFunction::Args&& args) {
+                      return this->vm->call(args[1], args[0]);
+                    })));
+  this->vm->run_script(TEST_SCRIPT(fn depth(n) {
+    if n == 0 {
+      ret 0;
+    }
+    if n % 2 == 0 {
+      ret through(depth, n - 1) + 1;
+    }
+    ret depth(n - 1) + 1;
+  } print depth(1000);));
+
+  EXPECT_EQ(this->ostream->str(), "1000\n");
+}
+
+TEST_P(TestVM, function_profiles_cover_the_whole_run_and_natives_calling_back)
+{
+  std::ostringstream out;
+  std::ostringstream folded;
+  VM vm(VMConfig(&std::cin, &out, OutputConfig(), GetParam(), ProfileConfig{.functions = true, .folded = &folded}));
+  vm.set_var("twice", Value(vm.make<NativeFunction>("twice", 1, [&](NativeFunction::Args&& args) {
+               return vm.call(args[0], vm.call(args[0], 1.0));
+             })));
+  vm.run_script(TEST_SCRIPT(fn inc(n) { ret n + 1; } fn fail(n) { ret -nil; } fn run() { ret twice(inc); } print run();));
+
+  EXPECT_EQ(out.str(), "3\n");
+  EXPECT_EQ(vm.function_profile().timing("inc").calls, 2);
+  EXPECT_EQ(vm.function_profile().timing("run").calls, 1);
+  EXPECT_NE(folded.str().find("script;run;twice;inc "), std::string::npos);
+
+  // calls from the host add to the profile without writing it out again
+  folded.str("");
+  vm.call(vm.get_var("inc"), 1.0);
+  EXPECT_THROW(vm.call(vm.get_var("fail"), 1.0), RuntimeError);
+  EXPECT_EQ(vm.function_profile().timing("inc").calls, 3);
+  EXPECT_EQ(vm.function_profile().depth(), 0);
+  EXPECT_TRUE(folded.str().empty());
+
+  vm.run(vm.compile(TEST_SCRIPT(print inc(1);)));
+  EXPECT_EQ(vm.function_profile().timing("inc").calls, 1);
+  EXPECT_FALSE(folded.str().empty());
+}
+
+TEST_P(TestVM, call_results_outlive_the_nursery)
+{
+  std::ostringstream out;
+  VM vm(VMConfig(&std::cin, &out, OutputConfig(), GetParam()), HeapConfig{.nursery_size = 256});
+  vm.run(vm.compile(TEST_SCRIPT(fn f(n) { ret n + " is a value long enough to skip sso"; })));
+
+  std::vector<Value> results;
+  for (int i = 0; i < 8; i++) { results.push_back(vm.call(vm.get_var("f"), static_cast<double>(i))); }
+
+  vm.run(vm.compile(TEST_SCRIPT(fn build() {
+    let str = "";
+    for let i = 0; i < 100; i = i + 1 {
+      str = str + "line " + i + "; ";
+    }
+    ret str;
+  } build();)));
+  EXPECT_GT(vm.heap_stats().minor_collections, 0);
+
+  for (int i = 0; i < 8; i++) { EXPECT_EQ(results[i].string(), std::to_string(i) + " is a value long enough to skip sso"); }
+}
+
+TEST_P(TestVM, arithmetic_chains_mix_numbers_and_other_values)
+{
+  this->vm->run_script(TEST_SCRIPT(fn f(a, s) {
+    let x = a * 2 + 1;
+    let y = x;
+    y = y - -x % 4;
+    let t = s + x;
+    if x > y {
+      ret 0;
+    }
+    ret t + (y / 2 == 7) + (x != 1);
+  } print f(5, "s"); print 1 + 2 * 3 - 4 / 2;));
+
+  EXPECT_EQ(this->ostream->str(), "s11truetrue\n5\n");
+  EXPECT_THROW(this->vm->run_script("let a = 1; print a + nil;"), RuntimeError);
+}